@@ -0,0 +1,517 @@
+/*  blockpart header
+
+  Partition of the grid into rectangular blocks, one per process.
+
+  linearpart gives each process a stripe of whole rows. With many
+  processes on a wide grid the stripes are only a few rows high and
+  most of the work is spent sharing the borders. blockpart arranges
+  the processes in a grid of px columns by py rows of blocks, chosen
+  so the blocks are as close to square as the number of processes
+  allows, and each block has borders on its four sides and in its
+  four corners.
+
+  blockpart keeps the interface of linearpart, the borders of the
+  sides and corners are shared, passed and added the same way as
+  the top and bottom borders of a linearpart.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email: qyfeng18@rcees.ac.cn
+*/
+
+#include "mpi.h"
+#include "partition.h"
+#include "linearpart.h"
+#include "rasterview.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <exception>
+#ifndef BLOCKPART_H
+#define BLOCKPART_H
+using namespace std;
+
+// Neighbors of a block, also the order of the border requests
+#define BP_TOP 0
+#define BP_BOTTOM 1
+#define BP_LEFT 2
+#define BP_RIGHT 3
+#define BP_TOPLEFT 4
+#define BP_TOPRIGHT 5
+#define BP_BOTTOMLEFT 6
+#define BP_BOTTOMRIGHT 7
+#define BP_NEIGHBORS 8
+
+// Number of block columns for size processes on a totalx by totaly grid,
+// the one giving the shortest block perimeter.
+inline int blockColumns(long totalx, long totaly, int size){
+	int best = 1;
+	double bestPerimeter = -1.0;
+	for(int px = 1; px <= size; px++){
+		if(size % px != 0) continue;
+		int py = size / px;
+		if(px > totalx || py > totaly) continue;
+		double perimeter = (double)totalx / px + (double)totaly / py;
+		if(bestPerimeter < 0.0 || perimeter < bestPerimeter){
+			best = px;
+			bestPerimeter = perimeter;
+		}
+	}
+	return best;
+}
+
+template <class datatype>
+class blockpart : public tdpartition {
+	protected:
+		// Member data inherited from partition
+		//long totalx, totaly;
+		//long nx, ny;
+		//double dx, dy;
+		int rank, size;
+		int px, py;          // number of block columns and rows
+		int pcol, prow;      // column and row of this block
+		long xoff, yoff;     // global coordinates of cell (0,0)
+		MPI_Datatype MPI_type;
+		MPI_Datatype columnType;
+		datatype noData;
+		datatype *gridData;
+		datatype *topBorder;
+		datatype *bottomBorder;
+		datatype *leftBorder;
+		datatype *rightBorder;
+		datatype corners[4];     // (-1,-1), (nx,-1), (-1,ny), (nx,ny)
+
+		// Neighboring processes, -1 where there is none
+		int neighbor[BP_NEIGHBORS];
+
+		//Persistent requests for share() and passBorders(), created in init()
+		int tag;
+		int nShareReqs, nPassReqs;
+		MPI_Request shareReqs[2*BP_NEIGHBORS];
+		MPI_Request passReqs[2*BP_NEIGHBORS];
+		datatype *recvTop;
+		datatype *recvBottom;
+		datatype *recvLeft;
+		datatype *recvRight;
+		datatype recvCorners[4];
+
+		long blockStart(long total, int nblocks, int b){return (total / nblocks) * b;}
+		long blockSize(long total, int nblocks, int b){
+			return total / nblocks + ((b == nblocks - 1) ? total % nblocks : 0);
+		}
+		datatype *haloCell(long x, long y);
+
+	public:
+		blockpart():tdpartition(){}
+		~blockpart();
+
+		void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd);
+		bool isInPartition(int x, int y);
+		bool hasAccess(int x, int y);
+
+		void share();
+		void shareStart();
+		void shareWait();
+		void passBorders();
+		void addBorders();
+		void clearBorders();
+		int ringTerm(int isFinished);
+		int ringTerm(int isFinished, long &borderUpdates);
+
+		bool globalToLocal(int globalX, int globalY, int &localX, int &localY);
+		void localToGlobal(int localX, int localY, int &globalX, int &globalY);
+
+		int getGridXY( int x,int y, int *i, int *j);
+		void transferPack( int *, int *, int *, int*);
+
+		void* getGridPointer(){return gridData;}
+		bool isNodata(long x, long y);
+		void setToNodata(long x, long y);
+		datatype getData(long x, long y, datatype &val);
+		void setData(long x, long y, datatype val);
+		void savedxdyc(tiffIO &obj);
+		void getdxdyc(long iny, double &val_dxc,double &val_dyc);
+		void addToData(long x, long y, datatype val);
+		RasterView<datatype> view();
+};
+
+
+//Destructor.  Just frees up memory.
+template <class datatype>
+blockpart<datatype>::~blockpart(){
+	int finalized;
+	MPI_Finalized(&finalized);
+	if(!finalized){
+		for(int i=0; i<nShareReqs; i++) MPI_Request_free(&shareReqs[i]);
+		for(int i=0; i<nPassReqs; i++) MPI_Request_free(&passReqs[i]);
+		MPI_Type_free(&columnType);
+	}
+	delete [] gridData;
+	delete [] topBorder;
+	delete [] bottomBorder;
+	delete [] leftBorder;
+	delete [] rightBorder;
+	delete [] recvTop;
+	delete [] recvBottom;
+	delete [] recvLeft;
+	delete [] recvRight;
+}
+
+//Init routine.  Same arguments as linearpart::init.
+template <class datatype>
+void blockpart<datatype>::init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, datatype nd){
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+
+	//Arrange the processes in blocks, by rows of blocks
+	px = blockColumns(totalx, totaly, size);
+	py = size / px;
+	pcol = rank % px;
+	prow = rank / px;
+
+	this->totalx = totalx;
+	this->totaly = totaly;
+	nx = blockSize(totalx, px, pcol);
+	ny = blockSize(totaly, py, prow);
+	xoff = blockStart(totalx, px, pcol);
+	yoff = blockStart(totaly, py, prow);
+	dxA = dx_in;
+	dyA = dy_in;
+	MPI_type = MPIt;
+	noData = nd;
+
+	//Allocate memory for data and fill with noData value.  Catch exceptions
+	uint64_t prod;
+	try
+	{
+		prod=(uint64_t)nx*ny;
+		gridData = new datatype[prod];
+		topBorder = new datatype[nx];
+		bottomBorder = new datatype[nx];
+		leftBorder = new datatype[ny];
+		rightBorder = new datatype[ny];
+		recvTop = new datatype[nx];
+		recvBottom = new datatype[nx];
+		recvLeft = new datatype[ny];
+		recvRight = new datatype[ny];
+	}
+	catch(bad_alloc&)
+	{
+		fprintf(stdout,"Memory allocation error during partition initialization in process %d.\n",rank);
+		fprintf(stdout,"NCols: %ld, NRows: %ld, NCells: %ld\n",nx,ny,(long)prod);
+		fflush(stdout);
+		MPI_Abort(MCW,-999);
+	}
+
+	for(uint64_t i=0; i<prod; i++) gridData[i] = noData;
+	for(long i=0; i<nx; i++) topBorder[i] = bottomBorder[i] = noData;
+	for(long i=0; i<ny; i++) leftBorder[i] = rightBorder[i] = noData;
+	for(int k=0; k<4; k++) corners[k] = noData;
+
+	after1=after2=before1=before2=NULL;
+
+	//Neighboring blocks
+	for(int k=0; k<BP_NEIGHBORS; k++) neighbor[k] = -1;
+	bool up = prow > 0, down = prow < py-1, left = pcol > 0, right = pcol < px-1;
+	if(up) neighbor[BP_TOP] = rank - px;
+	if(down) neighbor[BP_BOTTOM] = rank + px;
+	if(left) neighbor[BP_LEFT] = rank - 1;
+	if(right) neighbor[BP_RIGHT] = rank + 1;
+	if(up && left) neighbor[BP_TOPLEFT] = rank - px - 1;
+	if(up && right) neighbor[BP_TOPRIGHT] = rank - px + 1;
+	if(down && left) neighbor[BP_BOTTOMLEFT] = rank + px - 1;
+	if(down && right) neighbor[BP_BOTTOMRIGHT] = rank + px + 1;
+
+	//Set up the border exchanges once, as in linearpart.  The edge columns
+	//of the grid are sent with a strided datatype.
+	MPI_Type_vector(ny, 1, nx, MPI_type, &columnType);
+	MPI_Type_commit(&columnType);
+
+	datatype *sendCell[BP_NEIGHBORS] = { gridData, gridData+(ny-1)*nx, gridData, gridData+nx-1,
+		gridData, gridData+nx-1, gridData+(ny-1)*nx, gridData+(ny-1)*nx+nx-1 };
+	int sendCount[BP_NEIGHBORS] = { (int)nx, (int)nx, 1, 1, 1, 1, 1, 1 };
+	MPI_Datatype sendType[BP_NEIGHBORS] = { MPI_type, MPI_type, columnType, columnType,
+		MPI_type, MPI_type, MPI_type, MPI_type };
+	datatype *border[BP_NEIGHBORS] = { topBorder, bottomBorder, leftBorder, rightBorder,
+		&corners[0], &corners[1], &corners[2], &corners[3] };
+	datatype *recvBorder[BP_NEIGHBORS] = { recvTop, recvBottom, recvLeft, recvRight,
+		&recvCorners[0], &recvCorners[1], &recvCorners[2], &recvCorners[3] };
+	int borderCount[BP_NEIGHBORS] = { (int)nx, (int)nx, (int)ny, (int)ny, 1, 1, 1, 1 };
+
+	tag = newPartitionTag();
+	nShareReqs = nPassReqs = 0;
+	for(int k=0; k<BP_NEIGHBORS; k++){
+		if(neighbor[k] < 0) continue;
+		MPI_Send_init(sendCell[k], sendCount[k], sendType[k], neighbor[k], tag, MCW, &shareReqs[nShareReqs++]);
+		MPI_Recv_init(border[k], borderCount[k], MPI_type, neighbor[k], tag, MCW, &shareReqs[nShareReqs++]);
+		MPI_Send_init(border[k], borderCount[k], MPI_type, neighbor[k], tag+1, MCW, &passReqs[nPassReqs++]);
+		MPI_Recv_init(recvBorder[k], borderCount[k], MPI_type, neighbor[k], tag+1, MCW, &passReqs[nPassReqs++]);
+	}
+}
+
+//Returns true if (x,y) is in partition
+template <class datatype>
+bool blockpart<datatype>::isInPartition(int x, int y) {
+	return x>=0 && x<nx && y>=0 && y<ny;
+}
+
+//Returns true if (x,y) is in or on borders of partition
+template <class datatype>
+bool blockpart<datatype>::hasAccess(int x, int y) {
+	bool inx = x>=0 && x<nx;
+	bool iny = y>=0 && y<ny;
+	if(inx && iny) return true;
+	bool okx = inx || (x==-1 && pcol>0) || (x==nx && pcol<px-1);
+	bool oky = iny || (y==-1 && prow>0) || (y==ny && prow<py-1);
+	return okx && oky;
+}
+
+//Cell of the partition or of its borders, NULL outside
+template <class datatype>
+datatype *blockpart<datatype>::haloCell(long x, long y) {
+	if(y>=0 && y<ny){
+		if(x>=0 && x<nx) return gridData + y*nx + x;
+		if(x==-1) return leftBorder + y;
+		if(x==nx) return rightBorder + y;
+		return NULL;
+	}
+	int k;
+	if(y==-1) k = 0;
+	else if(y==ny) k = 2;
+	else return NULL;
+	if(x>=0 && x<nx) return (k==0 ? topBorder : bottomBorder) + x;
+	if(x==-1) return &corners[k];
+	if(x==nx) return &corners[k+1];
+	return NULL;
+}
+
+//Shares border information with the neighboring blocks, both sides and corners.
+template <class datatype>
+void blockpart<datatype>::share() {
+	shareStart();
+	shareWait();
+}
+
+template <class datatype>
+void blockpart<datatype>::shareStart() {
+	if(size<=1) return;
+	MPI_Startall(nShareReqs, shareReqs);
+}
+
+template <class datatype>
+void blockpart<datatype>::shareWait() {
+	if(size<=1) return;
+	MPI_Waitall(nShareReqs, shareReqs, MPI_STATUSES_IGNORE);
+}
+
+//Swaps border information with the neighboring blocks.  Borders with no
+//neighbor are left as they are.
+template <class datatype>
+void blockpart<datatype>::passBorders() {
+	if(size<=1) return;
+
+	MPI_Startall(nPassReqs, passReqs);
+	MPI_Waitall(nPassReqs, passReqs, MPI_STATUSES_IGNORE);
+	if(neighbor[BP_TOP] >= 0) memcpy(topBorder, recvTop, nx*sizeof(datatype));
+	if(neighbor[BP_BOTTOM] >= 0) memcpy(bottomBorder, recvBottom, nx*sizeof(datatype));
+	if(neighbor[BP_LEFT] >= 0) memcpy(leftBorder, recvLeft, ny*sizeof(datatype));
+	if(neighbor[BP_RIGHT] >= 0) memcpy(rightBorder, recvRight, ny*sizeof(datatype));
+	for(int k=0; k<4; k++)
+		if(neighbor[BP_TOPLEFT+k] >= 0) corners[k] = recvCorners[k];
+}
+
+//Swaps border information with the neighboring blocks, then adds the values
+//from the received borders to the edge cells next to them.
+template <class datatype>
+void blockpart<datatype>::addBorders(){
+	passBorders();
+
+	long i;
+	for(i=0; i<nx; i++){
+		if(neighbor[BP_TOP] >= 0){
+			if(isNodata(i,-1) || isNodata(i,0)) setData(i, 0, noData);
+			else addToData(i, 0, topBorder[i]);
+		}
+		if(neighbor[BP_BOTTOM] >= 0){
+			if(isNodata(i,ny) || isNodata(i,ny-1)) setData(i, ny-1, noData);
+			else addToData(i, ny-1, bottomBorder[i]);
+		}
+	}
+	for(i=0; i<ny; i++){
+		if(neighbor[BP_LEFT] >= 0){
+			if(isNodata(-1,i) || isNodata(0,i)) setData(0, i, noData);
+			else addToData(0, i, leftBorder[i]);
+		}
+		if(neighbor[BP_RIGHT] >= 0){
+			if(isNodata(nx,i) || isNodata(nx-1,i)) setData(nx-1, i, noData);
+			else addToData(nx-1, i, rightBorder[i]);
+		}
+	}
+	long cx[4] = { 0, nx-1, 0, nx-1 };
+	long cy[4] = { 0, 0, ny-1, ny-1 };
+	for(int k=0; k<4; k++){
+		if(neighbor[BP_TOPLEFT+k] < 0) continue;
+		long hx = (k%2 == 0) ? -1 : nx;
+		long hy = (k < 2) ? -1 : ny;
+		if(isNodata(hx,hy) || isNodata(cx[k],cy[k])) setData(cx[k], cy[k], noData);
+		else addToData(cx[k], cy[k], corners[k]);
+	}
+}
+
+//Clears borders (sets them to zero).
+template <class datatype>
+void blockpart<datatype>::clearBorders(){
+	for(long i=0; i<nx; i++) topBorder[i] = bottomBorder[i] = 0;
+	for(long i=0; i<ny; i++) leftBorder[i] = rightBorder[i] = 0;
+	for(int k=0; k<4; k++) corners[k] = 0;
+}
+
+//Termination check, same as linearpart::ringTerm.
+template <class datatype>
+int blockpart<datatype>::ringTerm(int isFinished) {
+	long borderUpdates = 0;
+	return ringTerm(isFinished, borderUpdates);
+}
+
+template <class datatype>
+int blockpart<datatype>::ringTerm(int isFinished, long &borderUpdates) {
+	if(size<=1) return isFinished;
+	long counts[2], totals[2];
+	counts[0] = (isFinished == NOTFINISHED) ? 1 : 0;
+	counts[1] = borderUpdates;
+	MPI_Allreduce(counts, totals, 2, MPI_LONG, MPI_SUM, MCW);
+	borderUpdates = totals[1];
+	return (totals[0] == 0) ? FINISHED : NOTFINISHED;
+}
+
+template <class datatype>
+bool blockpart<datatype>::globalToLocal(int globalX, int globalY, int &localX, int &localY){
+	localX = globalX - xoff;
+	localY = globalY - yoff;
+	return isInPartition(localX, localY);
+}
+
+template <class datatype>
+void blockpart<datatype>::localToGlobal(int localX, int localY, int &globalX, int &globalY){
+	globalX = xoff + localX;
+	globalY = yoff + localY;
+}
+
+template <class datatype>
+int blockpart<datatype>::getGridXY(int x, int y, int *i, int *j) {
+	*i = *j = -1;
+	if(x >= xoff && x < xoff+nx && y >= yoff && y < yoff+ny) {
+		*i = x - xoff;
+		*j = y - yoff;
+		return 1;
+	}
+	return 0;
+}
+
+//Only used for the outlets of the TauDEM upslope area functions, which work
+//on stripes.
+template <class datatype>
+void blockpart<datatype>::transferPack(int * /*countA*/, int * /*bufferAbove*/, int * /*countB*/, int * /*bufferBelow*/) {
+	if(size==1) return;
+	printf("transferPack is not available with block partitions\n");
+	fflush(stdout);
+	MPI_Abort(MCW,45);
+}
+
+//Returns true if grid element (x,y) is equal to noData.
+template <class datatype>
+bool blockpart<datatype>::isNodata(long x, long y){
+	datatype *p = haloCell(x, y);
+	if(p == NULL) return true;
+	return isNodataValue(*p, noData);
+}
+
+template <class datatype>
+void blockpart<datatype>::setToNodata(long x, long y){
+	datatype *p = haloCell(x, y);
+	if(p != NULL) *p = noData;
+}
+
+template <class datatype>
+datatype blockpart<datatype>::getData(long x, long y, datatype &val) {
+	datatype *p = haloCell(x, y);
+	if(p != NULL) val = *p;
+	return val;
+}
+
+template <class datatype>
+void blockpart<datatype>::setData(long x, long y, datatype val){
+	datatype *p = haloCell(x, y);
+	if(p != NULL) *p = val;
+}
+
+template <class datatype>
+void blockpart<datatype>::addToData(long x, long y, datatype val){
+	datatype *p = haloCell(x, y);
+	if(p != NULL) *p += val;
+}
+
+template <class datatype>
+void blockpart<datatype>::savedxdyc(tiffIO &obj) {
+	dxc = new double[ny];
+	dyc = new double[ny];
+	for(long i=0; i<ny; i++){
+		dxc[i] = obj.getdxc(yoff+i);
+		dyc[i] = obj.getdyc(yoff+i);
+	}
+}
+
+template <class datatype>
+void blockpart<datatype>::getdxdyc(long iny, double &val_dxc, double &val_dyc){
+	if(iny>=0 && iny<ny){ val_dxc=dxc[iny]; val_dyc=dyc[iny]; }
+}
+
+//Returns a view of the grid and all the borders for direct access in loops.
+template <class datatype>
+RasterView<datatype> blockpart<datatype>::view(){
+	RasterView<datatype> v;
+	v.data = gridData;
+	v.topBorder = topBorder;
+	v.bottomBorder = bottomBorder;
+	v.leftBorder = leftBorder;
+	v.rightBorder = rightBorder;
+	v.corners = corners;
+	v.nx = nx;
+	v.ny = ny;
+	v.noData = noData;
+	v.hasTop = prow > 0;
+	v.hasBottom = prow < py-1;
+	v.hasLeft = pcol > 0;
+	v.hasRight = pcol < px-1;
+	return v;
+}
+#endif
@@ -0,0 +1,207 @@
+/*  checkpoint header
+
+  Checkpoints of the distance passes of distToOutlets, so that a run
+  that stops can be started again with -restart from the last stage
+  that all the processes completed.
+
+  After the stream length pass each process writes its stream lengths
+  to <prefix>_<rank>.chk, from a thread of its own while the distance
+  passes run.  After the distances of a threshold are written out it
+  records the number of thresholds done in <prefix>_<rank>.done.  The
+  queue and the counts of contributing neighbors are empty between
+  these stages, so they are not saved.  A file is written under a
+  temporary name and then renamed, a run stopped while writing keeps
+  the previous one.
+
+  Each file starts with the layout of the partition and the options
+  of the run, a checkpoint of another grid, partition, number of
+  processes or thresholds is not used.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email: qyfeng18@rcees.ac.cn
+*/
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "commonLib.h"
+#include "partition.h"
+
+using namespace std;
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#define CHECKPOINTMAGIC 0x4b484344   // "DCHK"
+
+class DistCheckpoint {
+private:
+	char lengthsFile[MAXLN];
+	char doneFile[MAXLN];
+	vector <int64_t> header;
+	size_t cells;
+	thread writer;
+	atomic <bool> written;
+	bool named;           // false if a file name did not fit
+
+	// Write the header, then size bytes of each of the arrays that are
+	// not NULL, to file through a temporary file
+	bool writeFile(const char *file, const void *data1, const void *data2, size_t size) {
+		char tmp[MAXLN];
+		int len = snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+		if (len < 0 || len >= (int)sizeof(tmp)) return false;
+		FILE *f = fopen(tmp, "wb");
+		if (f == NULL) return false;
+		bool ok = fwrite(&header[0], sizeof(int64_t), header.size(), f) == header.size();
+		if (ok && data1 != NULL) ok = fwrite(data1, 1, size, f) == size;
+		if (ok && data2 != NULL) ok = fwrite(data2, 1, size, f) == size;
+		ok = (fclose(f) == 0) && ok;
+		if (ok) ok = rename(tmp, file) == 0;
+		if (!ok) remove(tmp);
+		return ok;
+	}
+
+	// Open file and check that it has the header of this run
+	FILE *openFile(const char *file) {
+		FILE *f = fopen(file, "rb");
+		if (f == NULL) return NULL;
+		vector <int64_t> found(header.size());
+		if (fread(&found[0], sizeof(int64_t), found.size(), f) != found.size() || found != header) {
+			fclose(f);
+			return NULL;
+		}
+		return f;
+	}
+
+	// True on all the processes if ok is true on all of them
+	static bool allOk(bool ok) {
+		int mine = ok ? 1 : 0, all;
+		MPI_Allreduce(&mine, &all, 1, MPI_INT, MPI_MIN, MCW);
+		return all == 1;
+	}
+
+public:
+	// Checkpoints of the lengths of the partition part, with the outputs
+	// given by subOlt and wsOlt, for the thresholds
+	DistCheckpoint(const char *prefix, tdpartition *part, bool subOlt, bool wsOlt,
+		const vector <int> &thresholds) : written(true) {
+		int rank, size;
+		MPI_Comm_rank(MCW, &rank);
+		MPI_Comm_size(MCW, &size);
+		// The names, and the temporary names with ".tmp" added, have
+		// to fit or the checkpoint cannot be used
+		int len1 = snprintf(lengthsFile, sizeof(lengthsFile), "%s_%d.chk", prefix, rank);
+		int len2 = snprintf(doneFile, sizeof(doneFile), "%s_%d.done", prefix, rank);
+		named = allOk(len1 >= 0 && len1 + 4 < MAXLN && len2 >= 0 && len2 + 4 < MAXLN);
+		int xstart, ystart;
+		part->localToGlobal(0, 0, xstart, ystart);
+		cells = (size_t)part->getnx() * part->getny();
+		int64_t fields[] = { CHECKPOINTMAGIC, size, rank, part->gettotalx(), part->gettotaly(),
+			xstart, ystart, part->getnx(), part->getny(), subOlt, wsOlt, (int64_t)thresholds.size() };
+		header.assign(fields, fields + sizeof(fields) / sizeof(fields[0]));
+		for (size_t n = 0; n < thresholds.size(); n++)
+			header.push_back(thresholds[n]);
+	}
+
+	// False on all the processes if the checkpoint files cannot be named
+	// from the prefix, the checkpoint is then not to be used
+	bool isNamed() { return named; }
+
+	~DistCheckpoint() {
+		writeWait();
+	}
+
+	// Read the lengths into sub and wsd, either may be NULL.  Returns
+	// true if all the processes have them, else the grids are left
+	// nodata and the lengths are to be computed.
+	bool readLengths(tdpartition *sub, tdpartition *wsd) {
+		size_t size = cells * sizeof(float);
+		bool ok = false;
+		FILE *f = openFile(lengthsFile);
+		if (f != NULL) {
+			ok = true;
+			if (sub != NULL) ok = fread(sub->getGridPointer(), 1, size, f) == size;
+			if (ok && wsd != NULL) ok = fread(wsd->getGridPointer(), 1, size, f) == size;
+			fclose(f);
+		}
+		if (allOk(ok)) return true;
+		if (sub != NULL) fill((float*)sub->getGridPointer(), (float*)sub->getGridPointer() + cells, MISSINGFLOAT);
+		if (wsd != NULL) fill((float*)wsd->getGridPointer(), (float*)wsd->getGridPointer() + cells, MISSINGFLOAT);
+		return false;
+	}
+
+	// Start writing the lengths in sub and wsd, which are not to change
+	// until isWritten() is true or writeWait has returned
+	void writeLengthsStart(tdpartition *sub, tdpartition *wsd) {
+		writeWait();
+		written = false;
+		const void *data1 = sub != NULL ? sub->getGridPointer() : NULL;
+		const void *data2 = wsd != NULL ? wsd->getGridPointer() : NULL;
+		writer = thread([this, data1, data2]() {
+			if (!writeFile(lengthsFile, data1, data2, cells * sizeof(float)))
+				printf("Could not write checkpoint %s\n", lengthsFile);
+			written = true;
+		});
+	}
+
+	// True once all the processes have written their lengths, to be
+	// called by all of them so they agree on the answer
+	bool isWritten() { return allOk(written); }
+
+	void writeWait() {
+		if (writer.joinable()) writer.join();
+	}
+
+	// Number of thresholds whose distances all the processes have written
+	int thresholdsDone() {
+		int done = 0, all;
+		FILE *f = openFile(doneFile);
+		if (f != NULL) {
+			int32_t n;
+			if (fread(&n, sizeof(n), 1, f) == 1) done = n;
+			fclose(f);
+		}
+		MPI_Allreduce(&done, &all, 1, MPI_INT, MPI_MIN, MCW);
+		return all;
+	}
+
+	void writeThresholdsDone(int done) {
+		int32_t n = done;
+		if (!writeFile(doneFile, &n, NULL, sizeof(n)))
+			printf("Could not write checkpoint %s\n", doneFile);
+	}
+};
+
+#endif
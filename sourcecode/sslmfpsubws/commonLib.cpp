@@ -41,11 +41,187 @@ email:  dtarb@usu.edu
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
+#include <algorithm>
 #include "commonLib.h"
 #include "linearpart.h"
+#include "createpart.h"
+#include "tiffIO.h"
+#include "initneighbor.h"
 #include <math.h>
 #include <cstddef>
+#include <vector>
 
+using namespace std;
+
+//  Partition type used by CreateNewPartition, set from the command line
+PART_TYPE partitionType = LINEAR_PART;
+
+//  Partition type from its command line name, returns 0 if the name is not known
+int parsePartitionType(const char *name, PART_TYPE &type)
+{
+	if(strcmp(name,"linear")==0) type = LINEAR_PART;
+	else if(strcmp(name,"block")==0) type = BLOCK_PART;
+	else if(strcmp(name,"balanced")==0) type = BALANCED_PART;
+	else return 0;
+	return 1;
+}
+
+//  First row of each process in the balanced partition, with the total
+//  number of rows at the end.  Empty until setPartitionRows is called.
+static vector<long> partitionRowStarts;
+
+//  Choose the stripes of the balanced partition from the number of valid
+//  cells in each of the totaly rows.  Each process gets at least one row,
+//  and a stripe ends where the cells above it reach its share of the total.
+void setPartitionRows(const long *rowCounts, long totaly)
+{
+	int size;
+	MPI_Comm_size(MCW,&size);
+	partitionRowStarts.assign(size+1, 0);
+	partitionRowStarts[size] = totaly;
+	if(totaly < size){
+		partitionRowStarts.clear();  //  Not enough rows, use equal stripes
+		return;
+	}
+	double total = 0.;
+	for(long j=0; j<totaly; j++) total += rowCounts[j];
+	long j = 0;
+	double cum = 0.;
+	for(int r=1; r<size; r++){
+		//  Equal stripes when there is nothing to balance
+		long start = (long)((double)r*totaly/size);
+		if(total > 0.){
+			double target = total*r/size;
+			while(j < totaly && cum + rowCounts[j] <= target) cum += rowCounts[j++];
+			start = j;
+		}
+		if(start < partitionRowStarts[r-1]+1) start = partitionRowStarts[r-1]+1;
+		if(start > totaly-(size-r)) start = totaly-(size-r);
+		partitionRowStarts[r] = start;
+	}
+}
+
+//  Rows of a process in the balanced partition, returns false if no plan
+//  was set for a grid with totaly rows
+bool getPartitionRows(long totaly, int rank, long &firstRow, long &numRows)
+{
+	if(partitionRowStarts.empty() || partitionRowStarts.back() != totaly) return false;
+	firstRow = partitionRowStarts[rank];
+	numRows = partitionRowStarts[rank+1] - firstRow;
+	return true;
+}
+
+//  Output options, LZW compressed stripes unless set otherwise
+OUTPUT_OPTIONS outputOptions = { 0, 256, "LZW", 0, "", 0 };
+
+bool useRoiWindow = false;
+
+int numThreads = 1;
+
+char checkpointPrefix[MAXLN] = "";
+bool restartRun = false;
+
+//  Thresholds from a list such as 1,5,10, returns 0 if an entry is not
+//  a number of at least 1.  A threshold given twice is kept once, in the
+//  place it first appears.
+int parseThresholds(const char *arg, vector<int> &thresholds)
+{
+	thresholds.clear();
+	const char *p = arg;
+	while(true){
+		char *end;
+		long t = strtol(p, &end, 10);
+		if(end == p || t < 1 || t > INT_MAX) return 0;
+		if(find(thresholds.begin(), thresholds.end(), (int)t) == thresholds.end())
+			thresholds.push_back((int)t);
+		if(*end == '\0') return 1;
+		if(*end != ',') return 0;
+		p = end + 1;
+	}
+}
+
+//  File for the output of threshold thresh, file itself for a single
+//  threshold, else file with _t<thresh> added before the extension
+void thresholdFileName(char *full, char *file, int thresh, bool several)
+{
+	if(!several){
+		strcpy(full, file);
+		return;
+	}
+	char suff[32];
+	sprintf(suff, "_t%d", thresh);
+	nameadd(full, file, suff);
+}
+
+//  True if arg is one of the output options read by parseOutputOption
+bool isOutputOption(const char *arg)
+{
+	return strcmp(arg,"-tiled")==0 || strcmp(arg,"-blocksize")==0 || strcmp(arg,"-compress")==0
+		|| strcmp(arg,"-predictor")==0 || strcmp(arg,"-bigtiff")==0 || strcmp(arg,"-overviews")==0;
+}
+
+//  Read the output option at argv[i] and its value, and move i past them.
+//  Returns 0 if the value is missing or not valid.
+int parseOutputOption(int argc, char **argv, int &i)
+{
+	const char *opt = argv[i++];
+	if(strcmp(opt,"-tiled")==0){
+		outputOptions.tiled = 1;
+		return 1;
+	}
+	if(strcmp(opt,"-overviews")==0){
+		outputOptions.overviews = 1;
+		return 1;
+	}
+	if(argc <= i) return 0;
+	char val[MAXLN];
+	strncpy(val,argv[i++],MAXLN-1);
+	val[MAXLN-1] = 0;
+	for(int k=0; val[k]; k++) val[k] = toupper(val[k]);
+	if(strcmp(opt,"-blocksize")==0){
+		//  GeoTIFF tiles must be a multiple of 16
+		if(sscanf(val,"%d",&outputOptions.blockSize) != 1 || outputOptions.blockSize < 16
+			|| outputOptions.blockSize % 16 != 0) return 0;
+		outputOptions.tiled = 1;
+	}
+	else if(strcmp(opt,"-compress")==0){
+		const char *methods[4] = {"LZW","DEFLATE","ZSTD","NONE"};
+		int k;
+		for(k=0; k<4; k++)
+			if(strcmp(val,methods[k])==0) break;
+		if(k == 4) return 0;
+		strcpy(outputOptions.compress,methods[k]);
+	}
+	else if(strcmp(opt,"-predictor")==0){
+		if(sscanf(val,"%d",&outputOptions.predictor) != 1 || outputOptions.predictor < 0
+			|| outputOptions.predictor > 3) return 0;
+	}
+	else if(strcmp(opt,"-bigtiff")==0){
+		const char *choices[3] = {"YES","NO","IF_SAFER"};
+		int k;
+		for(k=0; k<3; k++)
+			if(strcmp(val,choices[k])==0) break;
+		if(k == 3) return 0;
+		strcpy(outputOptions.bigtiff,choices[k]);
+	}
+	else return 0;
+	return 1;
+}
+
+void printOutputOptionsUsage()
+{
+	printf("Output options, for GeoTIFF output files:\n");
+	printf("[-tiled] [-blocksize <n>] [-compress lzw|deflate|zstd|none]\n");
+	printf("[-predictor <n>] [-bigtiff yes|no|if_safer] [-overviews]\n");
+	printf("-tiled writes tiles of <n> by <n> cells, 256 unless -blocksize is given.\n");
+	printf("-compress selects the compression, lzw by default. -predictor 2 helps\n");
+	printf("integer grids and 3 floating point grids with deflate, zstd and lzw.\n");
+	printf("-bigtiff is chosen from the grid size unless given. -overviews adds\n");
+	printf("internal overviews down to the size of one tile.\n");
+}
 
 //==================================
 /*  Nameadd(..)  Utility for adding suffixes to file names prior to
@@ -243,7 +419,7 @@ void initNeighborD8up(tdpartition* neighbor,tdpartition* flowData,queue<node> *q
 	//  Function to initialize the neighbor partition either whole partition or just upstream of outlets
 	//  and place locations with no neighbors that drain to them on the que
 	int i,j,k,in,jn;
-	short tempShort;
+	int8_t tempByte;
 	//float tempFloat,angle,p;
 	node temp;
 	if(useOutlets != 1) {
@@ -253,23 +429,23 @@ void initNeighborD8up(tdpartition* neighbor,tdpartition* flowData,queue<node> *q
 				//Initialize neighbor count to no data, but then 0 if flow direction is defined
 				neighbor->setToNodata(i,j);
 				if(!flowData->isNodata(i,j)) {
-					flowData->getData(i, j, tempShort);
-					if (tempShort >= 0 && tempShort <= 8) { // Flow direction data outside the range 1 to 8 effectively no data
+					flowData->getData(i, j, tempByte);
+					if (tempByte >= 0 && tempByte <= 8) { // Flow direction data outside the range 1 to 8 effectively no data
 						//Set contributing neighbors to 0 
-						neighbor->setData(i, j, (short)0);
+						neighbor->setData(i, j, (int8_t)0);
 						//Count number of contributing neighbors
 						for (k = 1; k <= 8; k++) {
 							in = i + d1[k];
 							jn = j + d2[k];
 							if (flowData->hasAccess(in, jn) && !flowData->isNodata(in, jn)) {
-								flowData->getData(in, jn, tempShort);
-								if (tempShort >= 0 && tempShort <= 8) {// Flow direction data outside the range 1 to 8 effectively no data
-									if (tempShort - k == 4 || tempShort - k == -4)
-										neighbor->addToData(i, j, (short)1);
+								flowData->getData(in, jn, tempByte);
+								if (tempByte >= 0 && tempByte <= 8) {// Flow direction data outside the range 1 to 8 effectively no data
+									if (tempByte - k == 4 || tempByte - k == -4)
+										neighbor->addToData(i, j, (int8_t)1);
 								}
 							}
 						}
-						if (neighbor->getData(i, j, tempShort) == 0) {
+						if (neighbor->getData(i, j, tempByte) == 0) {
 							//Push nodes with no contributing neighbors on queue
 							temp.x = i;
 							temp.y = j;
@@ -320,17 +496,17 @@ void initNeighborD8up(tdpartition* neighbor,tdpartition* flowData,queue<node> *q
 				// Only evaluate if cell hasn't been evaled yet
 				if(neighbor->isNodata(i,j)){
 					//Set contributing neighbors to 0
-					neighbor->setData(i,j,(short)0);
+					neighbor->setData(i,j,(int8_t)0);
 					//Count number of contributing neighbors
 					for(k=1; k<=8; k++){
 						in = i+d1[k];
 						jn = j+d2[k];
 						if(flowData->hasAccess(in,jn) && !flowData->isNodata(in,jn)){
-							flowData->getData(in, jn, tempShort);
-							if (tempShort >= 0 && tempShort <= 8) {// Flow direction data outside the range 1 to 8 effectively no data
+							flowData->getData(in, jn, tempByte);
+							if (tempByte >= 0 && tempByte <= 8) {// Flow direction data outside the range 1 to 8 effectively no data
 
 							//  Does neighbor drain to me
-								if (tempShort - k == 4 || tempShort - k == -4) {
+								if (tempByte - k == 4 || tempByte - k == -4) {
 									if (jn == -1) {
 										bufferAbove[countA] = in;
 										countA += 1;
@@ -344,12 +520,12 @@ void initNeighborD8up(tdpartition* neighbor,tdpartition* flowData,queue<node> *q
 										temp.y = jn;
 										toBeEvaled.push(temp);
 									}
-									neighbor->addToData(i, j, (short)1);
+									neighbor->addToData(i, j, (int8_t)1);
 								}
 							}
 						}
 					}					
-					if(neighbor->getData(i,j, tempShort) == 0){
+					if(neighbor->getData(i,j, tempByte) == 0){
 						//Push nodes with no contributing neighbors on queue
 						temp.x = i;
 						temp.y = j;
@@ -385,6 +561,75 @@ void initNeighborD8up(tdpartition* neighbor,tdpartition* flowData,queue<node> *q
 	}
 }
 
+//  Mark the cells upstream of the outlets in outletsfile, with the flow
+//  directions of flowDir, which must be read.  The outlets are read on
+//  rank 0 and placed on the grid of pf.  Returns a byte partition that
+//  is nodata outside the area draining to the outlets.
+tdpartition *upstreamOfOutlets(tdpartition *flowDir, tiffIO &pf, char *outletsfile)
+{
+	int rank;
+	MPI_Comm_rank(MCW,&rank);
+	if(partitionType == BLOCK_PART){
+		if(rank == 0) printf("Outlets are not available with block partitions\n");
+		fflush(stdout);
+		MPI_Abort(MCW,5);
+	}
+
+	int numOutlets = 0;
+	double *x = NULL, *y = NULL;
+	if(rank == 0){
+		if(readoutlets(outletsfile, NULL, 0, 0, pf.getspatialref(), &numOutlets, x, y) != 0){
+			printf("Exiting \n");
+			fflush(stdout);
+			MPI_Abort(MCW,5);
+		}
+	}
+	MPI_Bcast(&numOutlets, 1, MPI_INT, 0, MCW);
+	if(rank != 0){
+		x = new double[numOutlets];
+		y = new double[numOutlets];
+	}
+	MPI_Bcast(x, numOutlets, MPI_DOUBLE, 0, MCW);
+	MPI_Bcast(y, numOutlets, MPI_DOUBLE, 0, MCW);
+	int *outletsX = new int[numOutlets];
+	int *outletsY = new int[numOutlets];
+	for(int i = 0; i < numOutlets; i++)
+		pf.geoToGlobalXY(x[i], y[i], outletsX[i], outletsY[i]);
+
+	//  initNeighborD8up leaves the cells that do not drain to an outlet nodata
+	tdpartition *upstream = CreateNewPartition(BYTE_TYPE, flowDir->gettotalx(), flowDir->gettotaly(),
+		flowDir->getdxA(), flowDir->getdyA(), MISSINGBYTE);
+	flowDir->share();
+	queue<node> que;
+	initNeighborD8up(upstream, flowDir, &que, flowDir->getnx(), flowDir->getny(), 1,
+		outletsX, outletsY, numOutlets);
+
+	long cells = 0, totalCells;
+	for(int j = 0; j < flowDir->getny(); j++)
+		for(int i = 0; i < flowDir->getnx(); i++)
+			if(!upstream->isNodata(i, j)) cells++;
+	MPI_Allreduce(&cells, &totalCells, 1, MPI_LONG, MPI_SUM, MCW);
+	if(rank == 0){
+		printf("Cells upstream of %d outlets: %ld\n", numOutlets, totalCells);
+		fflush(stdout);
+	}
+
+	delete[] x;
+	delete[] y;
+	delete[] outletsX;
+	delete[] outletsY;
+	return upstream;
+}
+
+//  Set the cells of grid that are not upstream of the outlets to nodata,
+//  so the traversals and the outputs skip them
+void keepUpstream(tdpartition *grid, tdpartition *upstream)
+{
+	for(int j = 0; j < grid->getny(); j++)
+		for(int i = 0; i < grid->getnx(); i++)
+			if(upstream->isNodata(i, j)) grid->setToNodata(i, j);
+}
+
 // DGT 5/27/18 Remove from common lib and put in files of functions that use this to resolve header dependency on linearpart.h
 //returns true iff cell at [nrow][ncol] points to cell at [row][col]
 //bool pointsToMe(long col, long row, long ncol, long nrow, tdpartition *dirData){
@@ -45,6 +45,7 @@ email:  dtarb@usu.edu
 #include <stdint.h>
 #include "ogr_api.h"
 #include <queue>  // DGT 5/27/18
+#include <vector>
 
 #define MCW MPI_COMM_WORLD
 #define MAX_STRING_LENGTH 255
@@ -65,9 +66,55 @@ email:  dtarb@usu.edu
 enum DATA_TYPE
 	{ SHORT_TYPE,
 	  LONG_TYPE,
-	  FLOAT_TYPE
+	  FLOAT_TYPE,
+	  BYTE_TYPE    //  int8_t, for D8 flow directions and neighbor counts
 	};
 
+//  How CreateNewPartition divides the grid between processes
+enum PART_TYPE
+	{ LINEAR_PART,   //  stripes of whole rows, linearpart
+	  BLOCK_PART,    //  rectangular blocks, blockpart
+	  BALANCED_PART  //  stripes with about the same number of valid cells, linearpart
+	};
+extern PART_TYPE partitionType;
+int parsePartitionType(const char *name, PART_TYPE &type);
+void setPartitionRows(const long *rowCounts, long totaly);
+bool getPartitionRows(long totaly, int rank, long &firstRow, long &numRows);
+
+//  Creation options of the output grids, set from the command line and
+//  used by tiffIO::write for GeoTIFF files
+struct OUTPUT_OPTIONS {
+	int tiled;          //  1 for a tiled layout
+	int blockSize;      //  width and height of the tiles
+	char compress[16];  //  LZW, DEFLATE, ZSTD or NONE
+	int predictor;      //  0 for none, 2 horizontal differencing, 3 floating point
+	char bigtiff[16];   //  YES, NO or IF_SAFER, empty to decide from the grid size
+	int overviews;      //  1 to add internal overviews
+};
+extern OUTPUT_OPTIONS outputOptions;
+
+//  Set by -roi, the tools then only work on the bounding window of the
+//  valid watershed cells, see setValidWindow in tiffIO
+extern bool useRoiWindow;
+
+//  Set by -threads, the number of threads of each process that evaluate
+//  the cells in the distance passes, 0 for one per core
+extern int numThreads;
+
+//  Set by -checkpoint and -restart, the prefix of the checkpoint files of
+//  the distance passes, empty for none, and whether to start from them,
+//  see checkpoint.h
+extern char checkpointPrefix[MAXLN];
+extern bool restartRun;
+
+//  Stream thresholds given to -thresh as a comma separated list, and the
+//  output file of each when there are several
+int parseThresholds(const char *arg, std::vector<int> &thresholds);
+void thresholdFileName(char *full, char *file, int thresh, bool several);
+bool isOutputOption(const char *arg);
+int parseOutputOption(int argc, char **argv, int &i);
+void printOutputOptionsUsage();
+
 struct node {
 	int x;
 	int y;
@@ -75,6 +122,7 @@ struct node {
 
 const double PI =  3.14159265359;
 
+const int8_t MISSINGBYTE = -128;
 const int16_t MISSINGSHORT = -32768;
 
 const int32_t MISSINGLONG = -2147483647;
@@ -44,17 +44,34 @@ email:  dtarb@usu.edu
 #include "commonLib.h"
 //#include "partition.h"
 #include "linearpart.h"
+#include "blockpart.h"
+
+//  New partition of the type selected by partitionType
+template <class type>
+tdpartition *newPartitionOfType(){
+	if(partitionType == BLOCK_PART) return new blockpart<type>;
+	return new linearpart<type>;
+}
 
 // noDatarefactor 11/18/17  apparrently both functions are needed so that sometimes a no data pointer can be input and sometimes a nodata value
-tdpartition *CreateNewPartition(DATA_TYPE datatype, long totalx, long totaly, double dxA, double dyA, double nodata){
+inline tdpartition *CreateNewPartition(DATA_TYPE datatype, long totalx, long totaly, double dxA, double dyA, double nodata){
 	//Takes a double as the nodata parameter to accommodate double returns from GDAL through tiffIO
 
 	tdpartition* ptr = NULL;
 	int rank;
 	MPI_Comm_rank(MCW, &rank);//returns the rank of the calling processes in a communicator
 	
-	if(datatype == SHORT_TYPE){
-		ptr = new linearpart<int16_t>;
+	if(datatype == BYTE_TYPE){
+		ptr = newPartitionOfType<int8_t>();
+		int8_t ndinit = (int8_t)nodata;
+		if (rank == 0) {
+			printf("Nodata value input to create partition from file: %lf\n", nodata);
+			printf("Nodata value recast to int8_t used in partition raster: %d\n", ndinit);
+			fflush(stdout);
+		}
+		ptr->init(totalx, totaly, dxA, dyA, MPI_INT8_T, ndinit);
+	}else if(datatype == SHORT_TYPE){
+		ptr = newPartitionOfType<int16_t>();
 		int16_t ndinit = (int16_t)nodata;
 		if (rank == 0) {
 			printf("Nodata value input to create partition from file: %lf\n", nodata); 
@@ -63,7 +80,7 @@ tdpartition *CreateNewPartition(DATA_TYPE datatype, long totalx, long totaly, do
 		}
 		ptr->init(totalx, totaly, dxA, dyA, MPI_INT16_T, ndinit);
 	}else if(datatype == LONG_TYPE){
-		ptr = new linearpart<int32_t>;
+		ptr = newPartitionOfType<int32_t>();
 		int32_t ndinit = (int32_t)nodata;
 		if (rank == 0) {
 			printf("Nodata value input to create partition from file: %lf\n", nodata);
@@ -74,7 +91,7 @@ tdpartition *CreateNewPartition(DATA_TYPE datatype, long totalx, long totaly, do
 //		ptr = new linearpart<long>;
 //		ptr->init(totalx, totaly, dxA, dyA, MPI_LONG, *((long*)nodata));
 	}else if(datatype == FLOAT_TYPE){
-		ptr = new linearpart<float>;
+		ptr = newPartitionOfType<float>();
 		float ndinit = (float)nodata;
 		if (rank == 0) {
 			printf("Nodata value input to create partition from file: %lf\n", nodata);
@@ -92,17 +109,35 @@ tdpartition *CreateNewPartition(DATA_TYPE datatype, long totalx, long totaly, do
 	//Takes a constant as the nodata parameter, rather than a void pointer
 	tdpartition* ptr = NULL;
 	//printf("CP ND: %d\n", nodata); 	fflush(stdout);
-	if(datatype == SHORT_TYPE){
-		ptr = new linearpart<int16_t>;
+	if(datatype == BYTE_TYPE){
+		ptr = newPartitionOfType<int8_t>();
+		ptr->init(totalx, totaly, dxA, dyA, MPI_INT8_T, (int8_t)nodata);
+	}else if(datatype == SHORT_TYPE){
+		ptr = newPartitionOfType<int16_t>();
 		ptr->init(totalx, totaly, dxA, dyA, MPI_INT16_T, nodata);
 	}else if(datatype == LONG_TYPE){
-		ptr = new linearpart<int32_t>;
+		ptr = newPartitionOfType<int32_t>();
 		ptr->init(totalx, totaly, dxA, dyA, MPI_INT32_T, nodata);
 	}else if(datatype == FLOAT_TYPE){
-		ptr = new linearpart<float>;
+		ptr = newPartitionOfType<float>();
 		//float ndv = (float)(*nodata);
 		ptr->init(totalx, totaly, dxA, dyA, MPI_FLOAT, nodata);
 	}
 	return ptr;
 } 
+
+//Returns the view of a partition that must hold the given data type,
+//same as getData, a partition of another type is an error.
+template <class datatype>
+RasterView<datatype> partitionView(tdpartition *part){
+	linearpart<datatype> *lp = dynamic_cast<linearpart<datatype>*>(part);
+	if(lp != NULL) return lp->view();
+	blockpart<datatype> *bp = dynamic_cast<blockpart<datatype>*>(part);
+	if(bp == NULL){
+		printf("Attempt to view grid with incorrect data type\n");
+		fflush(stdout);
+		MPI_Abort(MCW,44);
+	}
+	return bp->view();
+}
 #endif
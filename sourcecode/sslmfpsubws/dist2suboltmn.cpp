@@ -41,12 +41,16 @@ email:  qyfeng18@rcees.ac.cn
 #include <stdlib.h>
 #include "commonLib.h"
 
-int distgrid(char *pfile, char *srcfile, char *wsfile, char *distfile, int thresh);
+int distgrid(char *pfile, char *srcfile, char *wsfile, char *distfile, char *wsdistfile, const std::vector<int> &thresholds, char *outletsfile);
 
 int main(int argc,char **argv)
 {
-   char pfile[MAXLN],srcfile[MAXLN], wsfile[MAXLN], distfile[MAXLN];
-   int err,nmain, thresh=1,i;
+   char pfile[MAXLN],srcfile[MAXLN], wsfile[MAXLN], distfile[MAXLN], wsdistfile[MAXLN];
+   int err,nmain,i;
+   std::vector<int> thresholds(1, 1);
+   char outletsfile[MAXLN];
+   outletsfile[0] = '\0';
+   wsdistfile[0] = '\0';
    
    if(argc < 2)
     {  
@@ -108,16 +112,77 @@ int main(int argc,char **argv)
 			}
 			else goto errexit;
 		}
+		else if(strcmp(argv[i],"-wsdist")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				strcpy(wsdistfile,argv[i]);
+				i++;
+			}
+			else goto errexit;
+		}
 		else if(strcmp(argv[i],"-thresh")==0)
 		{
 			i++;
 			if(argc > i)
 			{
-				sscanf(argv[i],"%d",&thresh);
+				if(!parseThresholds(argv[i],thresholds)) goto errexit;
 				i++;
 			}
 			else goto errexit;
 		}
+		else if(strcmp(argv[i],"-part")==0)
+		{
+			i++;
+			if(argc > i && parsePartitionType(argv[i], partitionType))
+				i++;
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-threads")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				sscanf(argv[i],"%d",&numThreads);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-checkpoint")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				strcpy(checkpointPrefix,argv[i]);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-restart")==0)
+		{
+			restartRun = true;
+			i++;
+		}
+		else if(strcmp(argv[i],"-o")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				strcpy(outletsfile,argv[i]);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-roi")==0)
+		{
+			useRoiWindow = true;
+			i++;
+		}
+		else if(isOutputOption(argv[i]))
+		{
+			if(!parseOutputOption(argc, argv, i)) goto errexit;
+		}
 		else 
 		{
 			goto errexit;
@@ -132,7 +197,7 @@ int main(int argc,char **argv)
 		nameadd(distfile,argv[1],"dist");
 	}
 
-    if(err=distgrid(pfile,srcfile,wsfile,distfile,thresh) != 0)
+    if(err=distgrid(pfile,srcfile,wsfile,distfile,wsdistfile,thresholds,outletsfile) != 0)
         printf("D8 distance to subarea outlet error %d\n",err);
 
 
@@ -141,13 +206,35 @@ int main(int argc,char **argv)
 	errexit:
 	   printf("Simple Usage:\n %s <basefilename>\n",argv[0]);
        printf("Usage with specific file names:\n %s -p <pfile>\n",argv[0]);
-	   printf("-src <srcfile> -dist <distfile> [-thresh <thresh>]\n");
+	   printf("-src <srcfile> -ws <wsfile> -dist <distfile> [-wsdist <wsdistfile>]\n");
+	   printf(" [-thresh <thresh>] [-part linear|block|balanced] [-roi]\n");
+	   printf(" [-threads <n>] [-o <outletsfile>] [-checkpoint <prefix> [-restart]]\n");
   	   printf("<basefilename> is the name of the base sslmfp model\n");
 	   printf("<pfile> is the d8 flow direction input file.\n");
        printf("<srcfile> is the stream raster input file.\n");
 	   printf("<wsfile> is the watershed boundary raster input file.\n");
-       printf("<distfile> is the distance to stream output file.\n");
-	   printf("The optional <thresh> is the user input threshold number.\n");
+       printf("<distfile> is the distance to subarea outlet output file.\n");
+	   printf("<wsdistfile> is the optional distance to watershed outlet output file,\n");
+	   printf("it is computed in the same pass as <distfile>, see dist2wsolt.\n");
+	   printf("The optional <thresh> is the user input threshold number, at least 1, or a\n");
+	   printf("comma separated list of thresholds such as 1,5,10 to compute the distances\n");
+	   printf("for each of them in one run, the output of each then has _t<thresh>\n");
+	   printf("added to its name.\n");
+	   printf("-part selects how the grids are divided between processes, in\n");
+	   printf("stripes of rows (linear, the default), in blocks, or in stripes\n");
+	   printf("with about the same number of valid flow direction cells (balanced).\n");
+	   printOutputOptionsUsage();
+	   printf("-threads sets the number of threads of each process that evaluate\n");
+	   printf("the cells in the distance passes, 0 for one per core, default 1.\n");
+	   printf("-checkpoint saves the stream lengths, and the thresholds whose\n");
+	   printf("distances are written, to files that start with <prefix>, one per\n");
+	   printf("process. -restart then starts again from them after a failed run\n");
+	   printf("with the same inputs, options and number of processes.\n");
+	   printf("-o restricts the run to the cells that drain to the points of\n");
+	   printf("<outletsfile>, the others are skipped and output as nodata. The\n");
+	   printf("flow paths then end at the outlets. Not available with -part block.\n");
+	   printf("-roi reads and processes only the bounding window of the watershed\n");
+	   printf("cells, the output is written at its place in the whole grid.\n");
        printf("The following are appended to the file names\n");
        printf("before the files are opened:\n");
        printf("p      D8 flow directions (input)\n");
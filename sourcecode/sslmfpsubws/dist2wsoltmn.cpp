@@ -40,12 +40,15 @@ email:  qyfeng18@rcees.ac.cn
 #include <stdlib.h>
 #include "commonLib.h"
 
-int distgrid(char *pfile, char *srcfile, char *distfile, int thresh);
+int distgrid(char *pfile, char *srcfile, char *distfile, const std::vector<int> &thresholds, char *outletsfile);
 
 int main(int argc,char **argv)
 {
    char pfile[MAXLN],srcfile[MAXLN],distfile[MAXLN];
-   int err,nmain, thresh=1,i;
+   int err,nmain,i;
+   std::vector<int> thresholds(1, 1);
+   char outletsfile[MAXLN];
+   outletsfile[0] = '\0';
    
    if(argc < 2)
     {  
@@ -101,11 +104,50 @@ int main(int argc,char **argv)
 			i++;
 			if(argc > i)
 			{
-				sscanf(argv[i],"%d",&thresh);
+				if(!parseThresholds(argv[i],thresholds)) goto errexit;
 				i++;
 			}
 			else goto errexit;
 		}
+		else if(strcmp(argv[i],"-threads")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				sscanf(argv[i],"%d",&numThreads);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-checkpoint")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				strcpy(checkpointPrefix,argv[i]);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-restart")==0)
+		{
+			restartRun = true;
+			i++;
+		}
+		else if(strcmp(argv[i],"-o")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				strcpy(outletsfile,argv[i]);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(isOutputOption(argv[i]))
+		{
+			if(!parseOutputOption(argc, argv, i)) goto errexit;
+		}
 		else 
 		{
 			goto errexit;
@@ -119,7 +161,7 @@ int main(int argc,char **argv)
 		nameadd(distfile,argv[1],"dist");
 	}
 
-    if(err=distgrid(pfile,srcfile,distfile,thresh) != 0)
+    if(err=distgrid(pfile,srcfile,distfile,thresholds,outletsfile) != 0)
         printf("D8 distance error %d\n",err);
 
 
@@ -128,12 +170,26 @@ int main(int argc,char **argv)
 	errexit:
 	   printf("Simple Usage:\n %s <basefilename>\n",argv[0]);
        printf("Usage with specific file names:\n %s -p <pfile>\n",argv[0]);
-	   printf("-src <srcfile> -dist <distfile> [-thresh <thresh>]\n");
+	   printf("-src <srcfile> -dist <distfile> [-thresh <thresh>] [-threads <n>]\n");
+	   printf(" [-o <outletsfile>] [-checkpoint <prefix> [-restart]]\n");
   	   printf("<basefilename> is the name of the base sslmfp model\n");
 	   printf("<pfile> is the d8 flow direction input file.\n");
        printf("<srcfile> is the stream raster input file.\n");
        printf("<distfile> is the distance to stream output file.\n");
-	   printf("The optional <thresh> is the user input threshold number.\n");
+	   printf("The optional <thresh> is the user input threshold number, at least 1, or a\n");
+	   printf("comma separated list of thresholds such as 1,5,10 to compute the distances\n");
+	   printf("for each of them in one run, the output of each then has _t<thresh>\n");
+	   printf("added to its name.\n");
+	   printOutputOptionsUsage();
+	   printf("-threads sets the number of threads of each process that evaluate\n");
+	   printf("the cells in the distance passes, 0 for one per core, default 1.\n");
+	   printf("-checkpoint saves the stream lengths, and the thresholds whose\n");
+	   printf("distances are written, to files that start with <prefix>, one per\n");
+	   printf("process. -restart then starts again from them after a failed run\n");
+	   printf("with the same inputs, options and number of processes.\n");
+	   printf("-o restricts the run to the cells that drain to the points of\n");
+	   printf("<outletsfile>, the others are skipped and output as nodata. The\n");
+	   printf("flow paths then end at the outlets.\n");
        printf("The following are appended to the file names\n");
        printf("before the files are opened:\n");
        printf("p      D8 flow directions (input)\n");
@@ -0,0 +1,996 @@
+/*  distolt header
+
+  Distance along the D8 flow paths from each cell to the outlet of its
+  subarea (dist2subolt) and to the outlet of the watershed (dist2wsolt).
+  Both are computed by the same traversal: a pass up the streams from
+  their ends accumulating the stream length, then a pass from the streams
+  up the hillslopes adding the length of each step.  They only differ in
+  that the stream length starts again from 0 where the subarea changes.
+  With several processes each pass follows the flow paths within the
+  partition first, then the cells on the edges of all the partitions
+  are solved at once, see Exits.
+
+  The outputs are chosen by the Outlets template argument, so a run
+  with one output does not carry the second distance grid, and a run
+  with both reads the grids and traverses them once.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email: qyfeng18@rcees.ac.cn
+*/
+
+#include <mpi.h>
+#include <math.h>
+#include <string.h>
+#include <limits.h>
+#include <queue>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
+#include "commonLib.h"
+#include "linearpart.h"
+#include "createpart.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+#ifndef DISTOLT_H
+#define DISTOLT_H
+
+// Outputs of distToOutlets
+struct SubOltDist {
+	static const bool subOlt = true;
+	static const bool wsOlt = false;
+};
+struct WsOltDist {
+	static const bool subOlt = false;
+	static const bool wsOlt = true;
+};
+struct BothOltDist {
+	static const bool subOlt = true;
+	static const bool wsOlt = true;
+};
+
+/*
+** InflowMask
+**
+** For each cell of the partition the neighbors that drain into it, with
+** bit k-1 set for the neighbor in direction k, so the traversals only
+** visit those neighbors.  all has every neighbor with a flow direction
+** pointing to the cell, stream only the ones that are also on a stream
+** (src > 0).  It is built once, after the flow direction and src borders
+** are shared, so the neighbors in the border rows and columns are
+** included.  Visit the neighbors of cell (x,y) with
+**     for (bits = mask.all(x, y); bits != 0; bits &= bits - 1)
+**         k = InflowMask::direction(bits);
+*/
+class InflowMask {
+private:
+	long nx, ny;
+	vector <uint8_t> allBits, streamBits;
+
+	// Mark cell (x,y) with flow direction d as draining into its neighbor
+	void mark(long x, long y, int d, bool onStream) {
+		if (d < 1 || d > 8) return;
+		long tx = x + d1[d];
+		long ty = y + d2[d];
+		if (tx < 0 || tx >= nx || ty < 0 || ty >= ny) return;
+		//  From the neighbor the cell is in the opposite direction
+		uint8_t bit = (uint8_t)(1 << ((d <= 4 ? d + 4 : d - 4) - 1));
+		allBits[ty * nx + tx] |= bit;
+		if (onStream) streamBits[ty * nx + tx] |= bit;
+	}
+
+public:
+	InflowMask() {
+		nx = ny = 0;
+	}
+
+	void build(const RasterView<int8_t> &dirv, const RasterView<int32_t> &srcv, const RowBitmap &dirMask) {
+		nx = dirv.nx;
+		ny = dirv.ny;
+		allBits.assign(nx * ny, 0);
+		streamBits.assign(nx * ny, 0);
+		for (long y = 0; y < ny; y++) {
+			const int8_t *dirrow = dirv.row(y);
+			for (long x = dirMask.first(y); x < nx; x = dirMask.next(y, x))
+				mark(x, y, dirrow[x], !srcv.isNodata(x, y) && srcv.get(x, y) > 0);
+		}
+		//  Cells of the border rows and columns that drain into the partition
+		for (long y = -1; y <= ny; y++) {
+			for (long x = -1; x <= nx; x++) {
+				if (y >= 0 && y < ny && x == 0) x = nx;
+				if (!dirv.hasAccess(x, y) || dirv.isNodata(x, y)) continue;
+				mark(x, y, dirv.get(x, y), !srcv.isNodata(x, y) && srcv.get(x, y) > 0);
+			}
+		}
+	}
+
+	uint8_t all(long x, long y) const { return allBits[y * nx + x]; }
+	uint8_t stream(long x, long y) const { return streamBits[y * nx + x]; }
+
+	// Direction of the lowest neighbor left in bits
+	static int direction(unsigned int bits) {
+#if defined(_MSC_VER)
+		unsigned long idx;
+		_BitScanForward(&idx, bits);
+		return (int)idx + 1;
+#else
+		return __builtin_ctz(bits) + 1;
+#endif
+	}
+};
+
+// Cells ahead in the queue whose grid values are prefetched while the
+// current cell is evaluated
+#ifndef DISTPREFETCH
+#define DISTPREFETCH 8
+#endif
+
+inline void prefetchCell(const void *p) {
+#if defined(__GNUC__)
+	__builtin_prefetch(p);
+#endif
+}
+
+// Value of the cell in direction p of cell idx = (i,j), through the
+// offsets when the cell is away from the edges of the partition
+template <class datatype>
+inline datatype downstreamValue(const RasterView<datatype> &v, uint32_t idx, int i, int j,
+	bool inner, int p, const long *off) {
+	if (inner) return v.data[idx + off[p]];
+	return v.get(i + d1[p], j + d2[p]);
+}
+
+// Reduce by 1 a count of contributing neighbors that the threads of
+// drainQueue share, returns the new count
+inline int8_t atomicDecrement(int8_t *count) {
+#if defined(_MSC_VER)
+	return (int8_t)(_InterlockedExchangeAdd8((char*)count, -1) - 1);
+#else
+	return __atomic_sub_fetch(count, (int8_t)1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// Reduce by 1 the count of contributing neighbors of the neighbor in
+// direction m of cell idx = (i,j), and queue it when it reaches 0.
+// Neighbors in the borders are only counted, they are queued by the
+// process they belong to after addBorders.
+inline void releaseNeighbor(RasterView<int8_t> &countv, CellQueue &que, uint32_t idx, int i, int j,
+	bool inner, int m, const long *off) {
+	if (inner) {
+		uint32_t n = idx + off[m];
+		if (atomicDecrement(countv.data + n) == 0) que.push(n);
+		return;
+	}
+	long in = i + d1[m];
+	long jn = j + d2[m];
+	int8_t *count = countv.cell(in, jn);
+	if (count == NULL) return;
+	if (atomicDecrement(count) == 0 && countv.isInPartition(in, jn))
+		que.push((uint32_t)(jn * countv.nx + in));
+}
+
+// Cells given to one thread of drainQueue.  The thread works from local,
+// and moves some of them to shared when it has many, where the other
+// threads take them when they run out.
+struct DrainWork {
+	CellQueue local;
+	std::mutex lock;
+	CellQueue shared;
+	std::atomic<size_t> sharedCount;
+	DrainWork(long nx) : local(nx), shared(nx), sharedCount(0) {}
+};
+
+// Cells moved to shared at a time, once local has twice as many
+const size_t STEALBATCH = 64;
+
+// Move to local cells shared by thread t, or else half of the cells
+// shared by another thread
+inline bool takeWork(vector <DrainWork*> &work, int t, CellQueue &local) {
+	int nthreads = (int)work.size();
+	for (int n = 0; n < nthreads; n++) {
+		DrainWork &w = *work[(t + n) % nthreads];
+		if (w.sharedCount.load(std::memory_order_relaxed) == 0) continue;
+		std::lock_guard<std::mutex> guard(w.lock);
+		size_t take = (n == 0) ? w.shared.size() : (w.shared.size() + 1) / 2;
+		for (size_t c = 0; c < take; c++)
+			local.push(w.shared.pop());
+		w.sharedCount.store(w.shared.size());
+		if (!local.empty()) return true;
+	}
+	return false;
+}
+
+// Evaluate the cells of que, and the cells they release, until there are
+// none left.  evaluate(idx, out) evaluates cell idx and pushes the cells
+// it releases on out, prefetch(idx) prefetches the grid values of a cell
+// that will be evaluated soon.  With more than one thread the cells are
+// shared out and each thread takes cells from the others when it runs
+// out, the order of the cells does not change the results because a cell
+// is only released once the cell downstream of it is done.
+template <class Evaluate, class Prefetch>
+void drainQueue(CellQueue &que, int nthreads, Evaluate &evaluate, Prefetch &prefetch)
+{
+	if (nthreads <= 1) {
+		while (!que.empty()) {
+			if (que.size() > DISTPREFETCH) prefetch(que.peek(DISTPREFETCH));
+			evaluate(que.pop(), que);
+		}
+		return;
+	}
+	if (que.empty()) return;
+
+	vector <DrainWork*> work(nthreads);
+	for (int t = 0; t < nthreads; t++)
+		work[t] = new DrainWork(que.width());
+	// Deal out the queued cells in runs, neighboring cells together
+	size_t total = que.size();
+	size_t run = (total + nthreads - 1) / nthreads;
+	for (size_t n = 0; n < total; n++)
+		work[n / run]->local.push(que.pop());
+
+	// Cells queued and not evaluated yet, in all the threads
+	std::atomic<long> pending((long)total);
+
+	auto drain = [&](int t) {
+		DrainWork &mine = *work[t];
+		CellQueue &local = mine.local;
+		while (true) {
+			if (local.empty() && !takeWork(work, t, local)) {
+				if (pending.load() == 0) return;
+				std::this_thread::yield();
+				continue;
+			}
+			if (local.size() > DISTPREFETCH) prefetch(local.peek(DISTPREFETCH));
+			long before = (long)local.size();
+			evaluate(local.pop(), local);
+			pending.fetch_add((long)local.size() - before);
+			if (local.size() >= 2 * STEALBATCH &&
+				mine.sharedCount.load(std::memory_order_relaxed) == 0) {
+				std::lock_guard<std::mutex> guard(mine.lock);
+				for (size_t c = 0; c < STEALBATCH; c++)
+					mine.shared.push(local.pop());
+				mine.sharedCount.store(mine.shared.size());
+			}
+		}
+	};
+	vector <std::thread> threads;
+	for (int t = 1; t < nthreads; t++)
+		threads.push_back(std::thread(drain, t));
+	drain(0);
+	for (auto &th : threads)
+		th.join();
+	for (int t = 0; t < nthreads; t++)
+		delete work[t];
+}
+
+// Exit of a cell whose value does not depend on another process
+const uint32_t NOEXIT = 0xFFFFFFFF;
+// Set in the exit of a cell whose value is not added to the value of
+// its exit, it only needs the exit to be reached.  These are the stream
+// cells upstream of a subarea boundary, they are only done once the
+// stream cell downstream is, and in the distance passes the cells whose
+// src is nodata and the cells upstream of them.
+const uint32_t RESETEXIT = 0x80000000;
+const int64_t RESETCELL = (int64_t)1 << 62;
+// Link of an edge cell without an exit, reached or not by the pass
+const int64_t REACHEDCELL = -1;
+const int64_t UNREACHEDCELL = -2;
+
+/*
+** Exits
+**
+** For each cell of the partition the border cell, of another process,
+** whose value its value is added to.  The first pass of each traversal
+** only follows the flow paths within the partition: a cell that drains
+** across the border keeps the length of its own step and the border cell
+** it drains to as its exit, and the cells upstream of it add their steps
+** and keep the same exit.  resolveExits then solves the values of the
+** border cells of all the processes at once and adds them, so a flow
+** path that crosses many partitions does not need one pass per border.
+** A flow path that is not reached by the pass on the other side, such
+** as one that ends in a loop or at a cell with no flow direction, would
+** never have been done by a single process, its cells get back the
+** value they had before the pass.
+** The border cell is coded by its position in the partition with its
+** borders, so the threads do not share a table of exits, this takes
+** fewer than 2^31 cells in a partition.
+*/
+class Exits {
+private:
+	long nx, ny;
+	vector <uint32_t> exits;
+
+public:
+	Exits() {
+		nx = ny = 0;
+	}
+
+	void init(long nxIn, long nyIn) {
+		nx = nxIn;
+		ny = nyIn;
+		exits.assign(nx * ny, NOEXIT);
+	}
+
+	uint32_t &operator[](uint32_t idx) { return exits[idx]; }
+
+	static uint32_t code(long x, long y, long nx) { return (uint32_t)((y + 1) * (nx + 2) + x + 1); }
+	void position(uint32_t c, long &x, long &y) const {
+		c &= ~RESETEXIT;
+		y = (long)(c / (nx + 2)) - 1;
+		x = (long)(c % (nx + 2)) - 1;
+	}
+	void clear() { std::fill(exits.begin(), exits.end(), NOEXIT); }
+};
+
+// Global number of cell (x,y) of the partition or of its borders
+inline int64_t globalCell(tdpartition *part, long x, long y) {
+	int gx, gy;
+	part->localToGlobal((int)x, (int)y, gx, gy);
+	return (int64_t)gy * part->gettotalx() + gx;
+}
+
+// Position of border cell (x,y) in a list of the border cells of a
+// partition of nx by ny, the top row, the bottom row, then the left
+// and the right columns
+inline long borderIndex(long x, long y, long nx, long ny) {
+	if (y == -1) return x + 1;
+	if (y == ny) return nx + 2 + x + 1;
+	if (x == -1) return 2 * (nx + 2) + y;
+	return 2 * (nx + 2) + ny + y;
+}
+
+// Value of a cell with an exit once the exit is solved to base.  A cell
+// that is nodata stays so, a cell with RESETEXIT keeps its value, the
+// others add base unless it is nodata.  unreached is returned when the
+// exit was not reached.
+inline float exitValue(float value, bool reset, float base, bool reached, float unreached, float noData)
+{
+	if (!reached) return unreached;
+	if (isNodataValue(value, noData)) return noData;
+	if (reset) return value;
+	if (isNodataValue(base, noData)) return noData;
+	return (float)(value + base);
+}
+
+// Add to the cells of the partition of v with an exit the value of their
+// exit.  The edge cells that a cell of another process drains to are
+// gathered on rank 0 with their values and exits, or with whether they
+// were reached by the pass when they have no exit.  countv are the
+// contributing neighbors of the pass, a cell is reached when its count
+// is 0, or -1 for a cell that started the pass and was then released
+// by the cell downstream.  Rank 0 solves them, from the cells without an exit up the
+// chains of exits, and sends each process the values of the border
+// cells it has exits to.  An exit to a cell that was not reached, or
+// that is on a loop of exits, gives the cell before(idx, value), its
+// value before the pass.  An exit to a nodata cell makes the cell
+// nodata, unless it has RESETEXIT.
+// Returns the number of edge cells solved on rank 0, the exits are
+// cleared.
+template <class Before>
+long resolveExits(tdpartition *part, RasterView<float> &v, Exits &exits,
+	const RasterView<int8_t> &dirv, const RasterView<int8_t> &countv, Before before)
+{
+	int rank, size;
+	MPI_Comm_rank(MCW, &rank);
+	MPI_Comm_size(MCW, &size);
+	long nx = v.nx, ny = v.ny;
+
+	//  The edge cells a border cell drains to, and the border cells that
+	//  the edge cells have exits to
+	vector <uint32_t> targets, requests;
+	for (long y = -1; y <= ny; y++) {
+		for (long x = -1; x <= nx; x++) {
+			if (y >= 0 && y < ny && x == 0) x = nx;
+			if (!dirv.hasAccess(x, y) || dirv.isNodata(x, y)) continue;
+			int p = dirv.get(x, y);
+			if (p < 1 || p > 8) continue;
+			if (dirv.isInPartition(x + d1[p], y + d2[p]))
+				targets.push_back((uint32_t)((y + d2[p]) * nx + x + d1[p]));
+		}
+	}
+	for (long y = 0; y < ny; y++) {
+		long step = (y == 0 || y == ny - 1 || nx == 1) ? 1 : nx - 1;
+		for (long x = 0; x < nx; x += step) {
+			uint32_t c = exits[(uint32_t)(y * nx + x)];
+			if (c != NOEXIT) requests.push_back(c & ~RESETEXIT);
+		}
+	}
+	sort(targets.begin(), targets.end());
+	targets.erase(unique(targets.begin(), targets.end()), targets.end());
+	sort(requests.begin(), requests.end());
+	requests.erase(unique(requests.begin(), requests.end()), requests.end());
+
+	vector <int64_t> cells, links, requestCells;
+	vector <float> values;
+	for (size_t n = 0; n < targets.size(); n++) {
+		uint32_t idx = targets[n];
+		uint32_t c = exits[idx];
+		long x = idx % nx, y = idx / nx;
+		cells.push_back(globalCell(part, x, y));
+		if (c == NOEXIT) {
+			int8_t count = countv.data[idx];
+			bool reached = count <= 0 && !isNodataValue(count, countv.noData);
+			links.push_back(reached ? REACHEDCELL : UNREACHEDCELL);
+		}
+		else {
+			long ex, ey;
+			exits.position(c, ex, ey);
+			links.push_back(globalCell(part, ex, ey) | ((c & RESETEXIT) ? RESETCELL : 0));
+		}
+		values.push_back(v.data[idx]);
+	}
+	for (size_t n = 0; n < requests.size(); n++) {
+		long ex, ey;
+		exits.position(requests[n], ex, ey);
+		requestCells.push_back(globalCell(part, ex, ey));
+	}
+
+	//  Gather them on rank 0
+	int sendCounts[2] = { (int)cells.size(), (int)requestCells.size() };
+	vector <int> allCounts(2 * size);
+	MPI_Gather(sendCounts, 2, MPI_INT, &allCounts[0], 2, MPI_INT, 0, MCW);
+	vector <int> counts(size), displs(size), rcounts(size), rdispls(size);
+	long long total = 0, rtotal = 0;
+	if (rank == 0) {
+		for (int r = 0; r < size; r++) {
+			counts[r] = allCounts[2 * r];
+			rcounts[r] = allCounts[2 * r + 1];
+			displs[r] = (int)total;
+			rdispls[r] = (int)rtotal;
+			total += counts[r];
+			rtotal += rcounts[r];
+			if (total >= INT_MAX || rtotal >= INT_MAX) {
+				printf("Border cells of the partitions exceed the MPI message size limit.\n");
+				fflush(stdout);
+				MPI_Abort(MCW, 32);
+			}
+		}
+	}
+	vector <int64_t> allCells(total + 1), allLinks(total + 1), allRequests(rtotal + 1);
+	vector <float> allValues(total + 1);
+	MPI_Gatherv(cells.data(), sendCounts[0], MPI_INT64_T, &allCells[0], &counts[0], &displs[0], MPI_INT64_T, 0, MCW);
+	MPI_Gatherv(links.data(), sendCounts[0], MPI_INT64_T, &allLinks[0], &counts[0], &displs[0], MPI_INT64_T, 0, MCW);
+	MPI_Gatherv(values.data(), sendCounts[0], MPI_FLOAT, &allValues[0], &counts[0], &displs[0], MPI_FLOAT, 0, MCW);
+	MPI_Gatherv(requestCells.data(), sendCounts[1], MPI_INT64_T, &allRequests[0], &rcounts[0], &rdispls[0], MPI_INT64_T, 0, MCW);
+
+	//  Solve each chain of exits once, from its end back to the cell it
+	//  was entered from, then answer the requests in the same order
+	vector <float> allBases(rtotal + 1);
+	vector <int8_t> allReached(rtotal + 1);
+	if (rank == 0) {
+		unordered_map <int64_t, long> edge;
+		edge.reserve(total);
+		for (long n = 0; n < total; n++)
+			edge[allCells[n]] = n;
+		enum { UNSOLVED, ON_CHAIN, SOLVED };
+		vector <char> state(total, UNSOLVED), reached(total, 0);
+		vector <long> chain;
+		for (long n = 0; n < total; n++) {
+			long e = n;
+			float base = v.noData;
+			bool isReached = false;
+			while (state[e] == UNSOLVED) {
+				if (allLinks[e] < 0) {
+					state[e] = SOLVED;
+					reached[e] = allLinks[e] == REACHEDCELL;
+					break;
+				}
+				state[e] = ON_CHAIN;
+				chain.push_back(e);
+				unordered_map <int64_t, long>::iterator it = edge.find(allLinks[e] & ~RESETCELL);
+				if (it == edge.end()) break;
+				e = it->second;
+			}
+			//  A loop of exits, or an exit to a cell that is not gathered,
+			//  is not reached
+			if (state[e] == SOLVED) {
+				base = allValues[e];
+				isReached = reached[e] != 0;
+			}
+			while (!chain.empty()) {
+				e = chain.back();
+				chain.pop_back();
+				base = exitValue(allValues[e], (allLinks[e] & RESETCELL) != 0, base, isReached, v.noData, v.noData);
+				allValues[e] = base;
+				reached[e] = isReached;
+				state[e] = SOLVED;
+			}
+		}
+		for (long n = 0; n < rtotal; n++) {
+			unordered_map <int64_t, long>::iterator it = edge.find(allRequests[n]);
+			allBases[n] = (it != edge.end()) ? allValues[it->second] : v.noData;
+			allReached[n] = (it != edge.end()) ? reached[it->second] : 0;
+		}
+	}
+
+	//  Send each process the values of its requests, then add them to
+	//  the cells with exits
+	vector <float> bases(requests.size() + 1);
+	vector <int8_t> basesReached(requests.size() + 1);
+	MPI_Scatterv(&allBases[0], &rcounts[0], &rdispls[0], MPI_FLOAT, &bases[0], sendCounts[1], MPI_FLOAT, 0, MCW);
+	MPI_Scatterv(&allReached[0], &rcounts[0], &rdispls[0], MPI_INT8_T, &basesReached[0], sendCounts[1], MPI_INT8_T, 0, MCW);
+	vector <float> borderBase(2 * (nx + 2) + 2 * ny, v.noData);
+	vector <int8_t> borderReached(borderBase.size(), 0);
+	long ex, ey;
+	for (size_t n = 0; n < requests.size(); n++) {
+		exits.position(requests[n], ex, ey);
+		long b = borderIndex(ex, ey, nx, ny);
+		borderBase[b] = bases[n];
+		borderReached[b] = basesReached[n];
+	}
+	for (long idx = 0; idx < nx * ny; idx++) {
+		uint32_t c = exits[(uint32_t)idx];
+		if (c == NOEXIT) continue;
+		exits.position(c, ex, ey);
+		long b = borderIndex(ex, ey, nx, ny);
+		float value = v.data[idx];
+		v.data[idx] = exitValue(value, (c & RESETEXIT) != 0, borderBase[b], borderReached[b] != 0,
+			borderReached[b] ? value : before((uint32_t)idx, value), v.noData);
+	}
+	exits.clear();
+	return (long)total;
+}
+
+// Distances to the subarea outlets and/or to the watershed outlet, on
+// grids that are already in memory, for each of the stream thresholds.
+// flowDir is a byte grid, src and ws are long grids, ws is only used
+// for the subarea distances and may be NULL otherwise.  The stream
+// lengths do not depend on the threshold, they are computed once.  Then
+// for each threshold output(n, subDist, wsDist) is called with the
+// distances for thresholds[n] in new float partitions that belong to
+// output, the one that is not computed is NULL.  The number of edge
+// cells solved by resolveExits in the stream length pass and in the
+// distance passes are put in borderCells when it is not NULL.  With a
+// checkpointPrefix the stream lengths and the thresholds done are saved,
+// with restartRun the run starts from them, see checkpoint.h.
+template <class Outlets, class Output>
+void distToOutlets(tdpartition *flowDir, tdpartition *src, tdpartition *ws, const vector <int> &thresholds,
+	Output &output, long *borderCells)
+{
+	int i,j,k;
+	double tempdxc,tempdyc;
+
+	long totalX = flowDir->gettotalx();
+	long totalY = flowDir->gettotaly();
+	double dxA = flowDir->getdxA();
+	double dyA = flowDir->getdyA();
+	int nx = flowDir->getnx();
+	int ny = flowDir->getny();
+
+	//Create empty partitions to store the stream lengths
+	tdpartition *subDist = NULL, *wsDist = NULL;
+	if (Outlets::subOlt)
+		subDist = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dxA, dyA, MISSINGFLOAT);
+	if (Outlets::wsOlt)
+		wsDist = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dxA, dyA, MISSINGFLOAT);
+
+	//With a checkpoint to restart from the stream lengths are read and the
+	//thresholds already written are skipped
+	DistCheckpoint *checkpoint = NULL;
+	bool haveLengths = false;
+	size_t firstThreshold = 0;
+	if (strlen(checkpointPrefix) > 0) {
+		int rank;
+		MPI_Comm_rank(MCW, &rank);
+		checkpoint = new DistCheckpoint(checkpointPrefix, flowDir, Outlets::subOlt, Outlets::wsOlt, thresholds);
+		if (!checkpoint->isNamed()) {
+			if (rank == 0) {
+				printf("Checkpoint prefix %s is too long, running without checkpoints\n", checkpointPrefix);
+				fflush(stdout);
+			}
+			delete checkpoint;
+			checkpoint = NULL;
+		}
+		else if (restartRun) {
+			haveLengths = checkpoint->readLengths(subDist, wsDist);
+			if (haveLengths) firstThreshold = checkpoint->thresholdsDone();
+			if (rank == 0) {
+				if (haveLengths)
+					printf("Restarting from checkpoint %s, %d of %d thresholds done\n",
+						checkpointPrefix, (int)firstThreshold, (int)thresholds.size());
+				else
+					printf("No checkpoint %s for this run, starting from the beginning\n", checkpointPrefix);
+				fflush(stdout);
+			}
+		}
+		if (checkpoint != NULL && !haveLengths) checkpoint->writeThresholdsDone(0);
+	}
+
+	/*  Calculate Distances  */
+	// The structure of dist is a rowno*9 array.
+	// Then for each row, get the horizental and vertical resolution,
+	// For each direction kk, calculate the distance for each flow direction.
+	float** dist = new float*[ny];
+	for (j = 0; j < ny; j++)
+	{
+		dist[j] = new float[9];
+	}
+	for (int m=0;m<ny;m++){
+		flowDir->getdxdyc(m,tempdxc,tempdyc);
+		for(int kk=1; kk<=8; kk++)
+		{
+			 dist[m][kk]=sqrt(d1[kk]*d1[kk]*tempdxc*tempdxc+d2[kk]*d2[kk]*tempdyc*tempdyc);
+		}
+	}
+
+	//XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+	//  Block to evaluate the stream length to the outlets
+	//Create empty partition to store number of contributing neighbors
+	tdpartition *contribs;
+	contribs = CreateNewPartition(BYTE_TYPE, totalX, totalY, dxA, dyA, MISSINGBYTE);
+
+	// The masks only use the rows of this process, they are built
+	// while the borders are exchanged.  The subarea of the cell
+	// downstream is needed across the borders too.
+	flowDir->shareStart();
+	src->shareStart();
+	if (Outlets::subOlt) ws->shareStart();
+
+	// Direct access to the grids in the loops below, with the cells
+	// that are not nodata marked for flow direction and stream grids
+	RasterView<int8_t> dirv = partitionView<int8_t>(flowDir);
+	RasterView<int32_t> srcv = partitionView<int32_t>(src);
+	RasterView<int32_t> wsv;
+	RasterView<float> sdv, wdv;
+	Exits subExits, wsExits;
+	if (Outlets::subOlt) {
+		wsv = partitionView<int32_t>(ws);
+		sdv = partitionView<float>(subDist);
+		subExits.init(nx, ny);
+	}
+	if (Outlets::wsOlt) {
+		wdv = partitionView<float>(wsDist);
+		wsExits.init(nx, ny);
+	}
+	RasterView<int8_t> contribv = partitionView<int8_t>(contribs);
+	RowBitmap dirMask, srcMask;
+	dirMask.build(dirv);
+	srcMask.build(srcv);
+
+	flowDir->shareWait();
+	src->shareWait();
+	if (Outlets::subOlt) ws->shareWait();
+
+	// The neighbors that drain into each cell, for both passes
+	InflowMask inflow;
+	inflow.build(dirv, srcv, dirMask);
+
+	// Offsets of the neighbors in the linear cell indices of the queue,
+	// used for the cells away from the edges of the partition
+	long off[9];
+	for (k = 0; k <= 8; k++)
+		off[k] = d1[k] + (long)d2[k] * nx;
+
+	int nthreads = numThreads;
+	if (nthreads <= 0) nthreads = (int)std::thread::hardware_concurrency();
+	if (nthreads <= 0) nthreads = 1;
+
+	// Where the cell in direction p of cell idx = (i,j) is: its index in
+	// the partition, or -1 with exit set to it when it is a border cell
+	// of another process, or -1 and NOEXIT outside the grid
+	auto downstream = [&](uint32_t idx, int i, int j, bool inner, int p, uint32_t &exit) -> long {
+		exit = NOEXIT;
+		if (inner) return (long)idx + off[p];
+		long in = i + d1[p];
+		long jn = j + d2[p];
+		if (dirv.isInPartition(in, jn)) return jn * nx + in;
+		if (dirv.hasAccess(in, jn)) exit = Exits::code(in, jn, nx);
+		return -1;
+	};
+
+	//  Initialize queue and contribs partition	
+	CellQueue que(nx);
+	int p;
+	long inext, jnext;
+	if (!haveLengths) {
+		for (j = 0; j < ny; ++j) {
+			const int32_t *srcrow = srcv.row(j);
+			const int8_t *dirrow = dirv.row(j);
+			for (i = srcMask.first(j); i < nx; i = srcMask.next(j, i)) {
+				// If I am on stream and my downslope neighbor is on stream contribs is 1
+				// If I am on stream and my downslope neighbor is off stream contribs is 0 because 
+				//  I am at the end of a stream.  A downslope neighbor of another
+				//  process is an exit, the cell is done in the first pass.
+				if (srcrow[i] > 0 && dirMask.isValid(i, j))
+				{
+					p = dirrow[i];
+					inext = i + d1[p];
+					jnext = j + d2[p];
+					if (!srcv.isNodata(inext, jnext) && 
+						srcv.get(inext, jnext) > 0 &&
+						!dirv.isNodata(inext, jnext) &&
+						dirv.isInPartition(inext, jnext))
+						contribv.set(i, j, (int8_t)1);
+					else
+					{
+						contribv.set(i, j, (int8_t)0);
+						que.push((uint32_t)j * nx + i);
+					}
+				}
+			}
+		}
+	}
+
+	// Stream length of a cell whose downstream stream cell is done.
+	// Start from the outlet and trace upwards.  If the next cell is no
+	// data the length is 0, else the step is added to it.  For the
+	// subarea outlets the length also starts from 0 where the next cell
+	// is in a different subarea.  A next stream cell of another process
+	// is the exit of the cell, with the step as its length.
+	auto lengthCell = [&](uint32_t idx, CellQueue &out) {
+		int j = idx / nx;
+		int i = idx - j * nx;
+		bool inner = i > 0 && i < nx - 1 && j > 0 && j < ny - 1;
+		int p = dirv.data[idx];
+		double tempdxc, tempdyc;
+		flowDir->getdxdyc(j, tempdxc, tempdyc);
+
+		// Length of the step to the next stream cell
+		double step = 0.;
+		if (p == 1 || p == 5) step = tempdxc;
+		if (p == 3 || p == 7) step = tempdyc;
+		if (p % 2 == 0) step = sqrt(tempdxc*tempdxc + tempdyc * tempdyc);
+
+		uint32_t exit;
+		long n = downstream(idx, i, j, inner, p, exit);
+		if (exit != NOEXIT) {
+			long in = i + d1[p];
+			long jn = j + d2[p];
+			if (srcv.isNodata(in, jn) || srcv.get(in, jn) <= 0 || dirv.isNodata(in, jn))
+				exit = NOEXIT;
+		}
+
+		float llength, next;
+		uint32_t nextExit;
+		if (Outlets::subOlt) {
+			llength = 0.;
+			next = (exit != NOEXIT) ? 0.f : downstreamValue(sdv, idx, i, j, inner, p, off);
+			nextExit = (n >= 0) ? subExits[(uint32_t)n] : exit;
+			subExits[idx] = NOEXIT;
+			if (wsv.data[idx] != downstreamValue(wsv, idx, i, j, inner, p, off)) {
+				if (nextExit != NOEXIT) subExits[idx] = nextExit | RESETEXIT;
+			}
+			else if (nextExit != NOEXIT || !isNodataValue(next, sdv.noData)) {
+				llength = (float)(next + step);
+				subExits[idx] = nextExit;
+			}
+			sdv.data[idx] = llength;
+		}
+		if (Outlets::wsOlt) {
+			llength = 0.;
+			next = (exit != NOEXIT) ? 0.f : downstreamValue(wdv, idx, i, j, inner, p, off);
+			nextExit = (n >= 0) ? wsExits[(uint32_t)n] : exit;
+			wsExits[idx] = NOEXIT;
+			if (nextExit != NOEXIT || !isNodataValue(next, wdv.noData)) {
+				llength = (float)(next + step);
+				wsExits[idx] = nextExit;
+			}
+			wdv.data[idx] = llength;
+		}
+
+		//  The stream neighbors that point to me, reduce their dependency by 1
+		for (unsigned int bits = inflow.stream(i, j); bits != 0; bits &= bits - 1)
+			releaseNeighbor(contribv, out, idx, i, j, inner, InflowMask::direction(bits), off);
+	};
+	auto lengthPrefetch = [&](uint32_t idx) {
+		prefetchCell(dirv.data + idx);
+		if (Outlets::subOlt) prefetchCell(sdv.data + idx);
+		if (Outlets::wsOlt) prefetchCell(wdv.data + idx);
+	};
+
+	// Lengths within the partition, then through the exits.  The
+	// checkpoint is written while the distance passes run.
+	long lengthCells = 0;
+	if (!haveLengths) {
+		drainQueue(que, nthreads, lengthCell, lengthPrefetch);
+		// The lengths were nodata before the pass
+		auto noLength = [](uint32_t, float) { return MISSINGFLOAT; };
+		if (Outlets::subOlt) lengthCells += resolveExits(subDist, sdv, subExits, dirv, contribv, noLength);
+		if (Outlets::wsOlt) lengthCells += resolveExits(wsDist, wdv, wsExits, dirv, contribv, noLength);
+		if (checkpoint != NULL) checkpoint->writeLengthsStart(subDist, wsDist);
+	}
+
+	//  Set neighbor partition to 1 because all grid cells drain to one other grid cell in D8
+	tdpartition *neighbor;
+	neighbor = CreateNewPartition(BYTE_TYPE, totalX, totalY, dxA, dyA, MISSINGBYTE);
+	RasterView<int8_t> neighborv = partitionView<int8_t>(neighbor);
+
+	// Stream threshold of the distance pass being run
+	int thresh = 0;
+
+	// Distance of a cell with no contributing neighbors left.  Off the
+	// streams the distance of the cell downstream plus the step to it,
+	// no data if the cell downstream is no data.  A cell downstream of
+	// another process is the exit of the cell, with the step as its
+	// distance.  A cell whose src is nodata keeps its value, its exit
+	// is the one of the cell downstream with RESETEXIT, as the cells
+	// upstream of it are only done once the cell downstream is.
+	auto distStep = [&](RasterView<float> &dv, Exits &exits, uint32_t idx, int j, int k,
+		long n, uint32_t exit, bool keep) {
+		uint32_t nextExit = (n >= 0) ? exits[(uint32_t)n] : exit;
+		if (keep) {
+			if (nextExit != NOEXIT) exits[idx] = nextExit | RESETEXIT;
+			return;
+		}
+		exits[idx] = nextExit;
+		if (n >= 0 ? isNodataValue(dv.data[n], dv.noData) : exit == NOEXIT)
+			dv.data[idx] = dv.noData;
+		else
+			dv.data[idx] = (float)(dist[j][k] + (n >= 0 ? dv.data[n] : 0.f));
+	};
+	auto distCell = [&](uint32_t idx, CellQueue &out) {
+		int j = idx / nx;
+		int i = idx - j * nx;
+		bool inner = i > 0 && i < nx - 1 && j > 0 && j < ny - 1;
+		bool keep = isNodataValue(srcv.data[idx], srcv.noData);
+		if (keep || srcv.data[idx] < thresh)
+		{
+			int k = dirv.data[idx];  //  Get neighbor downstream
+			uint32_t exit;
+			long n = downstream(idx, i, j, inner, k, exit);
+			if (Outlets::subOlt) distStep(sdv, subExits, idx, j, k, n, exit, keep);
+			if (Outlets::wsOlt) distStep(wdv, wsExits, idx, j, k, n, exit, keep);
+		}
+
+		//  Now find upslope cells and reduce dependencies
+		for (unsigned int bits = inflow.all(i, j); bits != 0; bits &= bits - 1)
+			releaseNeighbor(neighborv, out, idx, i, j, inner, InflowMask::direction(bits), off);
+	};
+	auto distPrefetch = [&](uint32_t idx) {
+		prefetchCell(dirv.data + idx);
+		prefetchCell(srcv.data + idx);
+	};
+
+	// A partition of distances that starts from the stream lengths, the
+	// last threshold takes the stream lengths themselves, unless they are
+	// still being written to the checkpoint or a stream cell below the
+	// threshold may need its length back from resolveExits
+	auto fromLengths = [&](tdpartition *lengths, bool last) -> tdpartition* {
+		if (last) return lengths;
+		tdpartition *d = CreateNewPartition(FLOAT_TYPE, totalX, totalY, dxA, dyA, MISSINGFLOAT);
+		memcpy(d->getGridPointer(), lengths->getGridPointer(), (size_t)nx * ny * sizeof(float));
+		return d;
+	};
+
+	// Value of cell idx before the distance pass, the stream length of
+	// the stream cells below the threshold, which are never on lengths
+	// that were taken, and nodata for the other cells it changes
+	auto beforeDist = [&](const float *lengths, uint32_t idx, float value) -> float {
+		int32_t s = srcv.data[idx];
+		if (isNodataValue(s, srcv.noData) || s >= thresh) return value;
+		return s > 0 ? lengths[idx] : MISSINGFLOAT;
+	};
+	auto subBefore = [&](uint32_t idx, float value) {
+		return beforeDist((const float*)subDist->getGridPointer(), idx, value);
+	};
+	auto wsBefore = [&](uint32_t idx, float value) {
+		return beforeDist((const float*)wsDist->getGridPointer(), idx, value);
+	};
+
+	long distCells = 0;
+	bool taken = false;
+	for (size_t n = firstThreshold; n < thresholds.size(); n++) {
+		thresh = thresholds[n];
+		bool last = n + 1 == thresholds.size();
+		if (last) {
+			int below = 0, anyBelow;
+			for (j = 0; j < ny && !below; j++) {
+				const int32_t *srcrow = srcv.row(j);
+				for (i = srcMask.first(j); i < nx; i = srcMask.next(j, i))
+					if (srcrow[i] > 0 && srcrow[i] < thresh) below = 1;
+			}
+			MPI_Allreduce(&below, &anyBelow, 1, MPI_INT, MPI_MAX, MCW);
+			last = !anyBelow && (checkpoint == NULL || checkpoint->isWritten());
+		}
+		taken = last;
+		tdpartition *subOut = NULL, *wsOut = NULL;
+		if (Outlets::subOlt) {
+			subOut = fromLengths(subDist, last);
+			sdv = partitionView<float>(subOut);
+		}
+		if (Outlets::wsOlt) {
+			wsOut = fromLengths(wsDist, last);
+			wdv = partitionView<float>(wsOut);
+		}
+
+		for(j=0; j<ny; j++){ // loop over rows
+			const int32_t *srcrow = srcv.row(j);
+			const int8_t *dirrow = dirv.row(j);
+			int8_t *nbrow = neighborv.row(j);
+			//Set contributing neighbors to 1, or to 0 for the cells that
+			//drain to another process, they are done in the first pass
+			for(i=dirMask.first(j); i<nx; i=dirMask.next(j,i)) {
+				nbrow[i] = 1;
+				if (j == 0 || j == ny - 1 || i == 0 || i == nx - 1) {
+					inext = i + d1[dirrow[i]];
+					jnext = j + d2[dirrow[i]];
+					if (!dirv.isInPartition(inext, jnext) && dirv.hasAccess(inext, jnext)) {
+						nbrow[i] = 0;
+						que.push((uint32_t)j * nx + i);
+					}
+				}
+			}
+			//If src is not nodata and the value equal or larger than threshold (default is 1),
+			// set the neighbour to 0 and start from this stream cell.
+			for(i=srcMask.first(j); i<nx; i=srcMask.next(j,i)) {
+				if(srcrow[i] >=thresh && nbrow[i] != 0){
+					nbrow[i] = 0;
+					que.push((uint32_t)j * nx + i);
+				}
+			}
+		}
+
+		// Distances within the partition, then through the exits
+		drainQueue(que, nthreads, distCell, distPrefetch);
+		if (Outlets::subOlt) distCells += resolveExits(subOut, sdv, subExits, dirv, neighborv, subBefore);
+		if (Outlets::wsOlt) distCells += resolveExits(wsOut, wdv, wsExits, dirv, neighborv, wsBefore);
+		output((int)n, subOut, wsOut);
+		if (checkpoint != NULL) checkpoint->writeThresholdsDone((int)n + 1);
+	}
+
+	if (checkpoint != NULL) {
+		checkpoint->writeWait();
+		delete checkpoint;
+	}
+	if (!taken) {
+		delete subDist;
+		delete wsDist;
+	}
+
+	for (j = 0; j < ny; j++)
+		delete[] dist[j];
+	delete[] dist;
+	delete contribs;
+	delete neighbor;
+
+	if (borderCells != NULL) {
+		borderCells[0] = lengthCells;
+		borderCells[1] = distCells;
+	}
+}
+
+// Distances for one stream threshold, returned in subDist and wsDist
+template <class Outlets>
+void distToOutlets(tdpartition *flowDir, tdpartition *src, tdpartition *ws, int thresh,
+	tdpartition *&subDist, tdpartition *&wsDist, long *borderCells)
+{
+	vector <int> thresholds(1, thresh);
+	auto keep = [&](int, tdpartition *sub, tdpartition *wsd) {
+		subDist = sub;
+		wsDist = wsd;
+	};
+	distToOutlets<Outlets>(flowDir, src, ws, thresholds, keep, borderCells);
+}
+
+#endif
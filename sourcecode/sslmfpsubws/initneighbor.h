@@ -1,5 +1,21 @@
+#ifndef INITNEIGHBOR_H
+#define INITNEIGHBOR_H
+
+#include <queue>
+#include "commonLib.h"
+#include "partition.h"
+#include "tiffIO.h"
+
+using namespace std;
+
 void initNeighborDinfup(tdpartition* neighbor,tdpartition* flowData,queue<node> *que,
 					  int nx,int ny,int useOutlets, int *outletsX,int *outletsY,long numOutlets);
 void initNeighborD8up(tdpartition* neighbor,tdpartition* flowData,queue<node> *que,
 					  int nx,int ny,int useOutlets, int *outletsX,int *outletsY,long numOutlets);  
 
+//  Cells upstream of the outlets of an outlets file (-o), and the grids
+//  restricted to them.  Not available with block partitions.
+tdpartition *upstreamOfOutlets(tdpartition *flowDir, tiffIO &pf, char *outletsfile);
+void keepUpstream(tdpartition *grid, tdpartition *upstream);
+
+#endif
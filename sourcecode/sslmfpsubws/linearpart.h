@@ -40,6 +40,7 @@ email:  dtarb@usu.edu
 
 #include "mpi.h"
 #include "partition.h"
+#include "rasterview.h"
 
 #include <queue>
 #include <stdio.h>
@@ -52,6 +53,15 @@ email:  dtarb@usu.edu
 #define LINEARPART_H
 using namespace std;
 
+//Returns a new pair of message tags for the border exchanges of a partition.
+//Partitions are created in the same order on every process, so the tags agree
+//and the exchanges of different partitions can be in flight at the same time.
+inline int newPartitionTag(){
+	static int lastTag = 100;
+	lastTag += 2;
+	return lastTag;
+}
+
 template <class datatype>
 class linearpart : public tdpartition {
 	protected:
@@ -65,6 +75,15 @@ class linearpart : public tdpartition {
 		datatype *gridData;
 		datatype *topBorder;
 		datatype *bottomBorder;
+		long rowStart;  //First row of the partition in the whole grid
+
+		//Persistent requests for share() and passBorders(), created in init()
+		int tag;
+		int nShareReqs, nPassReqs;
+		MPI_Request shareReqs[4];
+		MPI_Request passReqs[4];
+		datatype *recvTop;
+		datatype *recvBottom;
 
 	public:
 		linearpart():tdpartition(){}
@@ -75,10 +94,13 @@ class linearpart : public tdpartition {
 		bool hasAccess(int x, int y);
 
 		void share();
+		void shareStart();
+		void shareWait();
 		void passBorders();
 		void addBorders();
 		void clearBorders();
 		int ringTerm(int isFinished);
+		int ringTerm(int isFinished, long &borderUpdates);
 		
 		bool globalToLocal(int globalX, int globalY, int &localX, int &localY);
 		void localToGlobal(int localX, int localY, int &globalX, int &globalY);
@@ -99,6 +121,7 @@ class linearpart : public tdpartition {
 		void savedxdyc(tiffIO &obj);
 		void getdxdyc(long iny, double &val_dxc,double &val_dyc);
 		void addToData(long x, long y, datatype val);
+		RasterView<datatype> view();
 				
 		//void areaD(queue<node> *que);
 
@@ -114,9 +137,17 @@ class linearpart : public tdpartition {
 //Destructor.  Just frees up memory.
 template <class datatype>
 linearpart<datatype>::~linearpart(){
+	int finalized;
+	MPI_Finalized(&finalized);
+	if(!finalized){
+		for(int i=0; i<nShareReqs; i++) MPI_Request_free(&shareReqs[i]);
+		for(int i=0; i<nPassReqs; i++) MPI_Request_free(&passReqs[i]);
+	}
 	delete [] gridData;
 	delete [] bottomBorder;
 	delete [] topBorder;
+	delete [] recvTop;
+	delete [] recvBottom;
 }
 
 //Init routine.  Takes the total number of rows and columns in the ENTIRE grid to be partitioned,
@@ -130,8 +161,12 @@ void linearpart<datatype>::init(long totalx, long totaly, double dx_in, double d
 	this->totalx = totalx;
 	this->totaly = totaly;
 	nx = totalx;
-	ny = totaly / size;
-	if(rank == size-1)  ny += (totaly % size); //Add extra rows to the last process
+	//Equal stripes unless setPartitionRows chose the rows of each process
+	if(!getPartitionRows(totaly, rank, rowStart, ny)){
+		ny = totaly / size;
+		rowStart = rank * ny;
+		if(rank == size-1)  ny += (totaly % size); //Add extra rows to the last process
+	}
 	dxA = dx_in;
 	dyA = dy_in;
 	MPI_type = MPIt;
@@ -145,6 +180,8 @@ void linearpart<datatype>::init(long totalx, long totaly, double dx_in, double d
 		gridData = new datatype[prod];
 		topBorder = new datatype[nx];
 		bottomBorder = new datatype[nx];
+		recvTop = new datatype[nx];
+		recvBottom = new datatype[nx];
 	}
 	catch(bad_alloc&)
 	{
@@ -163,6 +200,27 @@ void linearpart<datatype>::init(long totalx, long totaly, double dx_in, double d
 
 	//TODO: find out what these are for
 	after1=after2=before1=before2=NULL;
+
+	//Set up the border exchanges once.  share() sends the first and last rows
+	//of the grid and receives into the borders, passBorders() sends the borders
+	//and receives into recvTop and recvBottom.  The buffers do not move, so the
+	//requests are only started and waited for on each call.
+	tag = newPartitionTag();
+	nShareReqs = nPassReqs = 0;
+	if(size>1){
+		if(rank>0){
+			MPI_Send_init(gridData, nx, MPI_type, rank-1, tag, MCW, &shareReqs[nShareReqs++]);
+			MPI_Recv_init(topBorder, nx, MPI_type, rank-1, tag, MCW, &shareReqs[nShareReqs++]);
+			MPI_Send_init(topBorder, nx, MPI_type, rank-1, tag+1, MCW, &passReqs[nPassReqs++]);
+			MPI_Recv_init(recvTop, nx, MPI_type, rank-1, tag+1, MCW, &passReqs[nPassReqs++]);
+		}
+		if(rank<size-1){
+			MPI_Send_init(gridData+((ny-1)*nx), nx, MPI_type, rank+1, tag, MCW, &shareReqs[nShareReqs++]);
+			MPI_Recv_init(bottomBorder, nx, MPI_type, rank+1, tag, MCW, &shareReqs[nShareReqs++]);
+			MPI_Send_init(bottomBorder, nx, MPI_type, rank+1, tag+1, MCW, &passReqs[nPassReqs++]);
+			MPI_Recv_init(recvBottom, nx, MPI_type, rank+1, tag+1, MCW, &passReqs[nPassReqs++]);
+		}
+	}
 }
 
 
@@ -191,121 +249,40 @@ bool linearpart<datatype>::hasAccess( int x, int y) {
 
 //Shares border information between adjacent processes.  Border information is stored
 //in the "topBorder" and "bottomBorder" arrays of each process.
+//Both directions are exchanged at once.
 template <class datatype>
 void linearpart<datatype>::share() {
-	MPI_Status status;
-	if(size<=1) return; //if there is only one process, we're all done sharing
-
-
-	datatype *ptr;
-	int place;
-	datatype *buf;
-	int bsize=nx*sizeof(datatype)+MPI_BSEND_OVERHEAD; 
-	buf = new datatype[bsize];
-
-	if(rank<size-1){
-		MPI_Buffer_attach(buf,bsize);
-		MPI_Bsend(gridData+((ny-1)*nx), nx, MPI_type, rank+1, 0, MCW);
-		MPI_Buffer_detach(&ptr,&place);
-	}
-	if(rank >0)	MPI_Recv(topBorder, nx, MPI_type, rank-1, 0, MCW, &status);
-	if(rank>0){
-		MPI_Buffer_attach(buf,bsize);
-		MPI_Bsend(gridData, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Buffer_detach(&ptr,&place);
-	}
-	if(rank<size-1) MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
-
-	delete [] buf;   // added by dww -- why not elsewhere?
-
-/*
-	if(rank == 0){ //Top partition in grid - only send and receive the bottom
-		
-//		cout << rank << " 1" << endl;
-		MPI_Bsend(gridData+((ny-1)*nx), nx, MPI_type, rank+1, 0, MCW);
-		MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
-//		cout << rank << " end" << endl;
-
-	}else if(rank == size-1){ //Bottom partition - only send and receive top
-		MPI_Bsend(gridData, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Recv(topBorder, nx, MPI_type, rank-1, 0, MCW, &status);
-//		cout << rank << " end" << endl;
-
-	}else{ //Send and receive top and bottom
-		MPI_Bsend(gridData+((ny-1)*nx), nx, MPI_type, rank+1, 0, MCW);
-		MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
-
-		MPI_Buffer_detach(&ptr,&place);
-		MPI_Buffer_attach(buf,bsize);
+	shareStart();
+	shareWait();
+}
 
-		MPI_Bsend(gridData, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Recv(topBorder, nx, MPI_type, rank-1, 0, MCW, &status);
-//		cout << rank << " end" << endl;
+//Starts sharing the borders and returns without waiting.  The grid may be read
+//and cells away from the first and last rows may be changed until shareWait().
+template <class datatype>
+void linearpart<datatype>::shareStart() {
+	if(size<=1) return; //if there is only one process, we're all done sharing
+	MPI_Startall(nShareReqs, shareReqs);
+}
 
-	}
-	MPI_Buffer_detach(&ptr,&place);
-*/
+//Waits until the borders started by shareStart() are received.
+template <class datatype>
+void linearpart<datatype>::shareWait() {
+	if(size<=1) return;
+	MPI_Waitall(nShareReqs, shareReqs, MPI_STATUSES_IGNORE);
 }
 
 //Swaps border information between adjacent processes.  In this way, no data is
 //overwritten.  If this function is called a second time, the original state is
-//restored.
+//restored.  The top border of the first process and the bottom border of the
+//last process have no neighbor and are left as they are.
 template <class datatype>
 void linearpart<datatype>::passBorders() {
-	MPI_Status status;
 	if(size<=1) return; //if there is only one process, we're all done sharing
 
-	datatype *ptr;
-	int place;
-	datatype *buf;
-	datatype *tempBorder;
-	int bsize=nx*sizeof(datatype)+MPI_BSEND_OVERHEAD; 
-	buf = new datatype[bsize];
-	tempBorder = new datatype[nx];
-
-	if(rank<size-1){
-		MPI_Buffer_attach(buf,bsize);
-		MPI_Bsend(bottomBorder, nx, MPI_type, rank+1, 0, MCW);
-		MPI_Buffer_detach(&ptr,&place);
-	}
-	if(rank >0)	MPI_Recv(tempBorder, nx, MPI_type, rank-1, 0, MCW, &status);
-	if(rank>0){
-		MPI_Buffer_attach(buf,bsize);
-		MPI_Bsend(topBorder, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Buffer_detach(&ptr,&place);
-	}
-	if(rank<size-1) MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
-	memmove(topBorder,tempBorder,nx*sizeof(datatype)); 
-
-	delete [] buf;   // added by dww -- why not elsewhere?
-	delete [] tempBorder;
-
-
-/*
-
-
-	if(rank == 0){ //Top partition in grid - only send and receive the bottom
-		MPI_Bsend(bottomBorder, nx, MPI_type, rank+1, 0, MCW);
-		MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
-
-	}else if(rank == size-1){ //Bottom partition - only send and receive top
-		MPI_Bsend(topBorder, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Recv(topBorder, nx, MPI_type, rank-1, 0, MCW, &status);
-
-	}else{ //Send and receive top and bottom
-		MPI_Bsend(bottomBorder, nx, MPI_type, rank+1, 0, MCW);
-		MPI_Recv(bottomBorder, nx, MPI_type, rank+1, 0, MCW, &status);
-
-		MPI_Buffer_detach(&ptr,&place);
-		MPI_Buffer_attach(buf,bsize);
-
-		MPI_Bsend(topBorder, nx, MPI_type, rank-1, 0, MCW);
-		MPI_Recv(topBorder, nx, MPI_type, rank-1, 0, MCW, &status);
-	}
-	MPI_Buffer_detach(&ptr,&place);
-*/
-
-
+	MPI_Startall(nPassReqs, passReqs);
+	MPI_Waitall(nPassReqs, passReqs, MPI_STATUSES_IGNORE);
+	if(rank>0) memcpy(topBorder, recvTop, nx*sizeof(datatype));
+	if(rank<size-1) memcpy(bottomBorder, recvBottom, nx*sizeof(datatype));
 }
 
 //Swaps border information between adjacent processes,
@@ -338,49 +315,27 @@ void linearpart<datatype>::clearBorders(){
 }
 
 
-//TODO: revisit the way this function works.  I don't like it.
-//      It really shouldn't even be here.
+//Termination check for the loops where each process empties its queue and
+//then passes borders.  Returns FINISHED only if isFinished is FINISHED on every
+//process.  A single MPI_Allreduce replaces the token that was passed twice
+//around all the processes.
 template <class datatype>
 int linearpart<datatype>::ringTerm(int isFinished) {
-	int ringBool = isFinished;
-	//The parameter isFinished tells us if the que is empty.
-	MPI_Status status;
-	//Ring termination check
-//	cout << rank << " ring Term begin" << endl;
-	if(size>1) {
-		//First processor will send a token.  It will tell the next proc if it is done or not
-		if( rank==0 ) {
-		//	cout << rank << " sending..." << endl;
-			MPI_Send( &ringBool, 1, MPI_INT, rank+1 ,1,MCW);
-			//cout << rank << " reciving..." << endl;
-			MPI_Recv( &ringBool, 1,MPI_INT, size-1,1,MCW,&status);
-			//cout << rank << " finished ..." << endl;
-		}
-		//The rest of the processors recv, if they are not finished, they change the token to NOTFINISHED
-		else {
-			//cout << rank << " reciving ..." << endl;
- 			MPI_Recv( &ringBool, 1,MPI_INT, rank-1,1,MCW,&status);
-			//cout << rank << " sending ..." << endl;
-			if( isFinished == NOTFINISHED ) ringBool = NOTFINISHED;
-			MPI_Send( &ringBool, 1,MPI_INT, (rank+1)%size, 1, MCW);
-			//cout << rank << " finished ..." << endl;
-		}
+	long borderUpdates = 0;
+	return ringTerm(isFinished, borderUpdates);
+}
 
-		//If the token came back as FINISHED, all ranks may quit, but first they need to know they can quit.
-		// First proc sends ringBool=FINISHED or NOTFINISHED, each processor sends it on until the last recieves it
-		if( rank==0 ) {
-			//cout << " distribute results" << endl;
-			MPI_Send( &ringBool, 1, MPI_INT, rank+1 ,1,MCW);
-		}
-		else {
-			//cout << " recive results" << endl;
-			MPI_Recv( &ringBool, 1,MPI_INT, rank-1,1,MCW,&status);
-			if( rank!=size-1)
-				MPI_Send( &ringBool, 1,MPI_INT, (rank+1)%size, 1, MCW);
-		}
-	}
-	//cout << rank <<" ring term end" << endl;
-	return ringBool; 
+//Same as above, and borderUpdates, the number of border cells this process
+//queued after the last pass, is summed over all processes in the same reduction.
+template <class datatype>
+int linearpart<datatype>::ringTerm(int isFinished, long &borderUpdates) {
+	if(size<=1) return isFinished;
+	long counts[2], totals[2];
+	counts[0] = (isFinished == NOTFINISHED) ? 1 : 0;  //processes not finished
+	counts[1] = borderUpdates;
+	MPI_Allreduce(counts, totals, 2, MPI_LONG, MPI_SUM, MCW);
+	borderUpdates = totals[1];
+	return (totals[0] == 0) ? FINISHED : NOTFINISHED;
 }
 
 //Converts global coordinates (for the whole grid) to local coordinates (for this
@@ -389,12 +344,8 @@ int linearpart<datatype>::ringTerm(int isFinished) {
 template <class datatype>
 bool linearpart<datatype>::globalToLocal(int globalX, int globalY, int &localX, int &localY){
 	localX = globalX;
-	localY = globalY - rank * ny;
-	//  For the last process ny is greater than the size of the other partitions so rank*ny does not get the row right.
-	//  totaly%size was added to ny for the last partition, so the size of partitions above is actually 
-	//  ny - totaly%size  (the remainder from dividing totaly by size).
-	if(rank == size-1) 
-		localY = globalY - rank * (ny - totaly%size); 
+	//  Partitions may have different numbers of rows, so use the first row kept by init
+	localY = globalY - rowStart;
 	return isInPartition(localX, localY);
 } 
 
@@ -402,9 +353,7 @@ bool linearpart<datatype>::globalToLocal(int globalX, int globalY, int &localX,
 template <class datatype>
 void linearpart<datatype>::localToGlobal(int localX, int localY, int &globalX, int &globalY){
 	globalX = localX;
-	globalY = rank * ny + localY;
-	if(rank == size-1) 
-		globalY = rank * (ny - totaly%size) + localY;
+	globalY = rowStart + localY;
 }
 
 //TODO: Figure out what this function is actually for.
@@ -412,11 +361,8 @@ void linearpart<datatype>::localToGlobal(int localX, int localY, int &globalX, i
 template <class datatype>
 int linearpart<datatype>::getGridXY( int x, int y, int *i, int *j) {
 	*i = *j = -1;
-	int numRowsPerProc = ny/size;
-	int starty = numRowsPerProc*rank;
-	if( rank == size-1)
-		numRowsPerProc += (totaly%size);
-	int  endy = starty + numRowsPerProc;
+	int starty = rowStart;
+	int  endy = starty + ny;
 	if( x >= 0 && x < nx && y >= starty && y < endy) {
 		*i = x;
 		*j = y - starty;
@@ -518,8 +464,7 @@ void linearpart<datatype>::savedxdyc( tiffIO &obj) {
     dxc=new double[ny];
 	dyc=new double[ny];
     for (int i=0;i<ny;i++){
-		int globalY = rank * ny +i;
-	if(rank == size-1) globalY = rank * (ny - totaly%size) + i;
+		int globalY = rowStart + i;
 	    dxc[i]=obj.getdxc(globalY);
 		dyc[i]=obj.getdyc(globalY);
 
@@ -562,4 +507,19 @@ void linearpart<datatype>::addToData(long inx, long iny, datatype val){
 		else if(y==ny) bottomBorder[x] += val;
 	}
 }
+
+//Returns a view of the grid and border rows for direct access in loops.
+template <class datatype>
+RasterView<datatype> linearpart<datatype>::view(){
+	RasterView<datatype> v;
+	v.data = gridData;
+	v.topBorder = topBorder;
+	v.bottomBorder = bottomBorder;
+	v.nx = nx;
+	v.ny = ny;
+	v.noData = noData;
+	v.hasTop = rank != 0;
+	v.hasBottom = rank != size-1;
+	return v;
+}
 #endif
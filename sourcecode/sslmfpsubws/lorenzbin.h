@@ -0,0 +1,397 @@
+/*  lorenzbin header
+
+  Binary output of the Lorenz curves, with the writer used by
+  lorenzfpsub and lorenzfpws and a reader for other programs.
+
+  The value and percent arrays of each (subarea, land use) curve
+  are stored as contiguous float columns, and an index at the end of
+  the file gives the offset of each curve by subarea and land use,
+  so one curve can be read without parsing the whole file.
+
+  Layout (native byte order, little endian on all our platforms):
+    LzBinHeader
+    columns of curve 0: elev values, elev percents, dist values,
+                        dist percents, slope values, slope percents
+    columns of curve 1 ...
+    LzBinEntry for each curve, by subarea and then land use
+    LzBinTrailer
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email: qyfeng18@rcees.ac.cn
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "lorenzfp.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifndef LORENZBIN_H
+#define LORENZBIN_H
+
+#define LZBINVERSION 1
+#define LZBINSUBFILE 0   // curves of each subarea, from lorenzfpsub
+#define LZBINWSFILE 1    // curves of the whole watershed, from lorenzfpws
+
+// Columns of a curve, in the order they are stored
+#define LZELEVVAL 0
+#define LZELEVPER 1
+#define LZDISTVAL 2
+#define LZDISTPER 3
+#define LZSLPVAL 4
+#define LZSLPPER 5
+
+struct LzBinHeader
+{
+	char magic[8];        // "SSLMFPLZ"
+	int32_t version;
+	int32_t filekind;     // LZBINSUBFILE or LZBINWSFILE
+	double dxc;           // cell size used for the areas
+	double dyc;
+};
+
+struct LzBinEntry
+{
+	int32_t subno;
+	int32_t luno;
+	int64_t offset;       // byte offset of the first column
+	int32_t nelev;        // number of points of each curve
+	int32_t ndist;
+	int32_t nslp;
+	int32_t totallucells;
+	int32_t totalsubcells;
+	float elevarea;
+	float distarea;
+	float slparea;
+	float luareaper;
+	int32_t reserved;
+};
+
+struct LzBinTrailer
+{
+	int64_t indexoffset;
+	int64_t nentries;
+	char magic[8];        // "SSLMFPIX"
+};
+
+
+class LorenzBinFile {
+private:
+	FILE *fp;
+	int64_t pos;
+	vector <LzBinEntry> index;
+	bool ok;              // false once a write failed
+
+	void writeColumn(vector <float> &col) {
+		if (!col.empty() && fwrite(&col[0], sizeof(float), col.size(), fp) != col.size())
+			ok = false;
+		pos += col.size() * sizeof(float);
+	}
+
+public:
+	LorenzBinFile(const char *fname, int filekind, double dxc, double dyc) {
+		pos = 0;
+		ok = true;
+		fp = fopen(fname, "wb");
+		if (fp == NULL)
+			return;
+		LzBinHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "SSLMFPLZ", 8);
+		header.version = LZBINVERSION;
+		header.filekind = filekind;
+		header.dxc = dxc;
+		header.dyc = dyc;
+		if (fwrite(&header, sizeof(header), 1, fp) != 1)
+			ok = false;
+		pos = sizeof(header);
+	}
+
+	bool isOpen() {
+		return fp != NULL;
+	}
+
+	// Write the curves, either all the land uses of one subarea
+	// or the land uses of the whole watershed.
+	void writeCurves(vector <Ludata*> &curves) {
+		if (fp == NULL) return;
+		LzBinEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		for (auto &ludt : curves) {
+			entry.subno = ludt->thissubno;
+			entry.luno = ludt->thisluno;
+			entry.offset = pos;
+			entry.nelev = ludt->elevarr.size();
+			entry.ndist = ludt->distarr.size();
+			entry.nslp = ludt->slparr.size();
+			entry.totallucells = ludt->totallucells;
+			entry.totalsubcells = ludt->totalsubcells;
+			entry.elevarea = ludt->elevarea;
+			entry.distarea = ludt->distarea;
+			entry.slparea = ludt->slparea;
+			entry.luareaper = ludt->luareaper;
+			index.push_back(entry);
+			writeColumn(ludt->elevarr);
+			writeColumn(ludt->elevperarr);
+			writeColumn(ludt->distarr);
+			writeColumn(ludt->distperarr);
+			writeColumn(ludt->slparr);
+			writeColumn(ludt->slpperarr);
+		}
+	}
+
+	// Write the index and close the file. Returns false if any
+	// write to the file failed.
+	bool close() {
+		if (fp == NULL) return ok;
+		LzBinTrailer trailer;
+		memset(&trailer, 0, sizeof(trailer));
+		trailer.indexoffset = pos;
+		trailer.nentries = index.size();
+		memcpy(trailer.magic, "SSLMFPIX", 8);
+		if (!index.empty() && fwrite(&index[0], sizeof(LzBinEntry), index.size(), fp) != index.size())
+			ok = false;
+		if (fwrite(&trailer, sizeof(trailer), 1, fp) != 1)
+			ok = false;
+		if (fclose(fp) != 0)
+			ok = false;
+		fp = NULL;
+		return ok;
+	}
+
+	~LorenzBinFile() {
+		close();
+	}
+};
+
+
+/*
+** LorenzBinReader
+**
+** Reads a file written by LorenzBinFile. The file is memory mapped
+** where available, so column() gives the curve values in place.
+** Otherwise only the index is read and the columns of a curve are
+** read from the file when asked for.
+*/
+class LorenzBinReader {
+private:
+	FILE *fp;
+	const char *mapped;
+	size_t mappedsize;
+	LzBinHeader header;
+	vector <LzBinEntry> index;
+	vector <float> colbuf;
+
+	bool readAt(int64_t offset, void *dest, size_t nbytes) {
+		if (mapped != NULL) {
+			if (offset < 0 || offset + (int64_t)nbytes > (int64_t)mappedsize) return false;
+			memcpy(dest, mapped + offset, nbytes);
+			return true;
+		}
+		if (fseek(fp, offset, SEEK_SET) != 0) return false;
+		return fread(dest, 1, nbytes, fp) == nbytes;
+	}
+
+	int64_t columnOffset(int i, int col) {
+		LzBinEntry &e = index[i];
+		int64_t off = e.offset;
+		int32_t lens[6] = { e.nelev, e.nelev, e.ndist, e.ndist, e.nslp, e.nslp };
+		for (int c = 0; c < col; c++)
+			off += (int64_t)lens[c] * sizeof(float);
+		return off;
+	}
+
+public:
+	LorenzBinReader() {
+		fp = NULL;
+		mapped = NULL;
+		mappedsize = 0;
+	}
+
+	// Open the file and read its index, returns false if the file
+	// can not be read or is not a Lorenz binary file.
+	bool open(const char *fname) {
+		close();
+		fp = fopen(fname, "rb");
+		if (fp == NULL) return false;
+		fseek(fp, 0, SEEK_END);
+		int64_t filesize = ftell(fp);
+#ifndef _WIN32
+		int fd = ::open(fname, O_RDONLY);
+		if (fd >= 0) {
+			void *p = mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (p != MAP_FAILED) {
+				mapped = (const char *)p;
+				mappedsize = filesize;
+			}
+		}
+#endif
+		LzBinTrailer trailer;
+		if (filesize < (int64_t)(sizeof(header) + sizeof(trailer))
+			|| !readAt(0, &header, sizeof(header))
+			|| !readAt(filesize - sizeof(trailer), &trailer, sizeof(trailer))
+			|| memcmp(header.magic, "SSLMFPLZ", 8) != 0
+			|| memcmp(trailer.magic, "SSLMFPIX", 8) != 0
+			|| header.version != LZBINVERSION) {
+			close();
+			return false;
+		}
+		// The index lies between the curves and the trailer
+		int64_t indexend = filesize - (int64_t)sizeof(trailer);
+		if (trailer.nentries < 0
+			|| trailer.indexoffset < (int64_t)sizeof(header)
+			|| trailer.indexoffset > indexend
+			|| trailer.nentries != (indexend - trailer.indexoffset) / (int64_t)sizeof(LzBinEntry)
+			|| trailer.indexoffset + trailer.nentries * (int64_t)sizeof(LzBinEntry) != indexend) {
+			close();
+			return false;
+		}
+		index.resize(trailer.nentries);
+		if (trailer.nentries > 0
+			&& !readAt(trailer.indexoffset, &index[0], trailer.nentries * sizeof(LzBinEntry))) {
+			close();
+			return false;
+		}
+		// The columns of each curve lie before the index
+		for (size_t i = 0; i < index.size(); i++) {
+			LzBinEntry &e = index[i];
+			if (e.offset < (int64_t)sizeof(header) || e.offset > trailer.indexoffset || e.nelev < 0 || e.ndist < 0 || e.nslp < 0
+				|| e.offset + 2 * ((int64_t)e.nelev + e.ndist + e.nslp) * (int64_t)sizeof(float) > trailer.indexoffset) {
+				close();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	int fileKind() { return header.filekind; }
+	double dxc() { return header.dxc; }
+	double dyc() { return header.dyc; }
+	int nCurves() { return index.size(); }
+	LzBinEntry &entry(int i) { return index[i]; }
+
+	// First curve of the subarea, or -1. The curves are stored by
+	// subarea so the ones of a subarea follow each other.
+	int findSub(int subno) {
+		int lo = 0, hi = index.size();
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (index[mid].subno < subno) lo = mid + 1;
+			else hi = mid;
+		}
+		if (lo < (int)index.size() && index[lo].subno == subno)
+			return lo;
+		return -1;
+	}
+
+	// Curve of the subarea and land use, or -1
+	int find(int subno, int luno) {
+		int i = findSub(subno);
+		if (i < 0) return -1;
+		for (; i < (int)index.size() && index[i].subno == subno; i++) {
+			if (index[i].luno == luno)
+				return i;
+		}
+		return -1;
+	}
+
+	// Number of values in column col (LZELEVVAL ... LZSLPPER) of curve i
+	int columnSize(int i, int col) {
+		if (col < LZDISTVAL) return index[i].nelev;
+		if (col < LZSLPVAL) return index[i].ndist;
+		return index[i].nslp;
+	}
+
+	// Values of column col of curve i. With a mapped file this points
+	// into the file, otherwise to a buffer valid until the next call.
+	const float *column(int i, int col) {
+		int n = columnSize(i, col);
+		int64_t off = columnOffset(i, col);
+		if (n < 0) return NULL;
+		if (mapped != NULL) {
+			if (off < 0 || off + (int64_t)n * (int64_t)sizeof(float) > (int64_t)mappedsize) return NULL;
+			return (const float *)(mapped + off);
+		}
+		colbuf.resize(n > 0 ? n : 1);
+		if (!readAt(off, &colbuf[0], n * sizeof(float)))
+			return NULL;
+		return &colbuf[0];
+	}
+
+	// Copy curve i into a Ludata
+	bool readCurve(int i, Ludata *ludt) {
+		LzBinEntry &e = index[i];
+		ludt->thissubno = e.subno;
+		ludt->thisluno = e.luno;
+		ludt->totallucells = e.totallucells;
+		ludt->totalsubcells = e.totalsubcells;
+		ludt->elevarea = e.elevarea;
+		ludt->distarea = e.distarea;
+		ludt->slparea = e.slparea;
+		ludt->luareaper = e.luareaper;
+		vector <float> *cols[6] = { &ludt->elevarr, &ludt->elevperarr, &ludt->distarr,
+			&ludt->distperarr, &ludt->slparr, &ludt->slpperarr };
+		for (int c = 0; c < 6; c++) {
+			const float *v = column(i, c);
+			if (v == NULL) return false;
+			cols[c]->assign(v, v + columnSize(i, c));
+		}
+		return true;
+	}
+
+	void close() {
+#ifndef _WIN32
+		if (mapped != NULL)
+			munmap((void *)mapped, mappedsize);
+#endif
+		mapped = NULL;
+		mappedsize = 0;
+		if (fp != NULL)
+			fclose(fp);
+		fp = NULL;
+		index.clear();
+	}
+
+	~LorenzBinReader() {
+		close();
+	}
+};
+
+#endif
@@ -32,6 +32,9 @@ email: qyfeng18@rcees.ac.cn
 */
 
 #include <algorithm>
+#include <vector>
+#include <limits.h>
+#include <math.h>
 
 using namespace std;
 
@@ -64,348 +67,313 @@ struct Ludata
 
 
 
-int totallunos;
+// Map ids to compact indexes, given in the order the ids are added.
+// Small non negative ids, like land use codes and subarea numbers,
+// are looked up directly in an array. Other ids are kept in a sorted
+// list and found by binary search.
+#define DENSEIDS 1048576
 
-class HashTableEntry {
+class IdIndexMap {
+private:
+	vector <int> dense;
+	vector <pair <long, int> > sparse;
 public:
-	int k;
-	Ludata *v;
-	HashTableEntry(int k, Ludata *v) {
-		this->k = k;
-		this->v = v;
+	vector <long> ids;
+
+	int find(long id) {
+		if (id >= 0 && id < DENSEIDS) {
+			if (id < (long)dense.size())
+				return dense[id];
+			return -1;
+		}
+		vector <pair <long, int> >::iterator it =
+			lower_bound(sparse.begin(), sparse.end(), make_pair(id, INT_MIN));
+		if (it != sparse.end() && it->first == id)
+			return it->second;
+		return -1;
 	}
-};
 
-class HashMapTable {
-private:
-	HashTableEntry **t;
-public:
-	HashMapTable() {
-		t = new HashTableEntry *[totallunos];
-		for (int i = 0; i < totallunos; i++) {
-			t[i] = NULL;
+	int add(long id) {
+		int idx = find(id);
+		if (idx >= 0)
+			return idx;
+		idx = ids.size();
+		ids.push_back(id);
+		if (id >= 0 && id < DENSEIDS) {
+			if (id >= (long)dense.size())
+				dense.resize(id + 1, -1);
+			dense[id] = idx;
 		}
+		else {
+			sparse.insert(lower_bound(sparse.begin(), sparse.end(), make_pair(id, INT_MIN)),
+				make_pair(id, idx));
+		}
+		return idx;
 	}
 
-	int HashFunc(int k) {
-		return k % totallunos;
+	int size() {
+		return ids.size();
 	}
 
-	void Insert(int k, Ludata *v) {
-		int h = HashFunc(k);
-		while (t[h] != NULL && t[h]->k != k) {
-			h = HashFunc(h + 1);
-		}
-		if (t[h] != NULL)
-			delete t[h];
-		t[h] = new HashTableEntry(k, v);
+	void clear() {
+		vector <int>().swap(dense);
+		vector <pair <long, int> >().swap(sparse);
+		vector <long>().swap(ids);
 	}
+};
 
-	int SearchKey(int k) {
-		int h = HashFunc(k);
-		//printf("search key: h: %d, k: %d\n", h, k);
-		while (t[h] != NULL && t[h]->k != k) {
-			h = HashFunc(h + 1);
-		}
 
-		if (t[h] == NULL)
-			return -1;
-		else
-			return t[h]->v->thisluno;
+/*
+** caltrapzarea()
+**
+** Calculates the area of a trapozoid shape.
+** Four inputs are required. In this application:
+** 1. the x axis value (elevation, distance or slope),
+**    will be used as height of the shape.
+** 2. the y axis value (percentage calculated)
+**    will be used as the top (x) and bottom (x+1).
+*/
+float caltrapzarea(float olu1, float olu2, float perlu1, float perlu2)
+{
+	float traparea = (olu2 - olu1)*(perlu1 + perlu2) / (float)2;
+	return traparea;
+}
+
+bool compare_float(float x, float y, float epsilon = 0.001f) {
+	if (fabs(x - y) < epsilon)
+		return true; //they are same
+	return false; //they are not same
+}
+
+
+/*
+** buildLorenzCurve()
+**
+** Builds the Lorenz curve of n sorted values in one sweep.
+** The percent of value i is (i+1)*100/n, the percentage of the
+** cells at or below it. When values are duplicates only the last
+** one is kept, with its percent, so the curve has one point per
+** distinct value. Slope values closer than compare_float() are
+** taken as duplicates when nearSame is true, other values only
+** when equal. The area under the curve is summed over the kept
+** points as trapezoids and returned.
+*/
+float buildLorenzCurve(const float *sorted, long long n, bool nearSame,
+	vector <float> &valarr, vector <float> &perarr)
+{
+	float area = 0.0;
+	float prevval = 0.0, prevper = 0.0;
+	float per;
+	for (long long i = 0; i < n; i++) {
+		if (i + 1 < n) {
+			if (nearSame ? compare_float(sorted[i], sorted[i + 1]) : sorted[i] == sorted[i + 1])
+				continue;
+		}
+		per = (float)((float)(i + 1.0)*100.0 / n);
+		if (!valarr.empty())
+			area += caltrapzarea(prevval, sorted[i], prevper, per);
+		valarr.push_back(sorted[i]);
+		perarr.push_back(per);
+		prevval = sorted[i];
+		prevper = per;
 	}
+	return area;
+}
+
+
+/*
+** SubLuTable
+**
+** Stores the elevation, distance and slope values of every
+** (subarea, land use) pair. It is filled in two passes over the grid:
+** 1. count(): a census of the cells of each pair, which also
+**    finds the subarea and land use ids,
+** 2. addCell(): after allocate(), each value is written straight
+**    into its place in one buffer per variable.
+** The pairs are stored as buckets numbered subidx * nlus + luidx,
+** with the subareas in increasing order and the land uses in the
+** order they were found (or given with setLuOrder()).
+*/
+class SubLuTable {
+private:
+	IdIndexMap subIdx;
+	IdIndexMap luIdx;
+	vector <vector <long long> > census;
+	vector <long long> offsets;
+	vector <long long> cursor;
+	vector <float> elevbuf;
+	vector <float> distbuf;
+	vector <float> slpbuf;
 
-	Ludata *getLuData(int k) {
-		int h = HashFunc(k);
-		while (t[h] != NULL && t[h]->k != k) {
-			h = HashFunc(h + 1);
-		}
+public:
+	// Count n cells of the given subarea and land use
+	void count(long subno, long luno, long long n = 1) {
+		int si = subIdx.add(subno);
+		int li = luIdx.add(luno);
+		if (si >= (int)census.size())
+			census.resize(si + 1);
+		if (li >= (int)census[si].size())
+			census[si].resize(li + 1, 0);
+		census[si][li] += n;
+	}
 
-		return t[h]->v;
+	// Land use ids in the order they are found
+	vector <long> &luids() {
+		return luIdx.ids;
 	}
 
+	vector <long> &subids() {
+		return subIdx.ids;
+	}
 
-	void Remove(int k) {
-		int h = HashFunc(k);
-		while (t[h] != NULL) {
-			if (t[h]->k == k)
-				break;
-			h = HashFunc(h + 1);
-		}
-		if (t[h] == NULL) {
-			cout << "No Element found at key " << k << endl;
-			return;
+	// Use the given order for the land uses. The list must contain
+	// all the land uses counted so far and may contain other ones,
+	// so that the tables of all processes use the same indexes.
+	void setLuOrder(vector <long> &order) {
+		IdIndexMap newLuIdx;
+		for (auto &luid : order)
+			newLuIdx.add(luid);
+		for (auto &row : census) {
+			vector <long long> newRow(newLuIdx.size(), 0);
+			for (int li = 0; li < (int)row.size(); li++)
+				newRow[newLuIdx.find(luIdx.ids[li])] = row[li];
+			row.swap(newRow);
 		}
-		else {
-			delete t[h];
-		}
-		cout << "Element Deleted" << endl;
+		luIdx = newLuIdx;
 	}
 
+	// Sort the subareas, lay the buckets out from the census and
+	// allocate the value buffers.
+	void allocate() {
+		vector <long> sorted(subIdx.ids);
+		sort(sorted.begin(), sorted.end());
+		IdIndexMap newSubIdx;
+		vector <vector <long long> > newCensus(sorted.size());
+		for (auto &subno : sorted) {
+			int oldsi = subIdx.find(subno);
+			newCensus[newSubIdx.add(subno)].swap(census[oldsi]);
+		}
+		subIdx = newSubIdx;
+
+		int nsub = nsubs(), nlu = nlus();
+		offsets.assign((size_t)nsub * nlu + 1, 0);
+		long long total = 0;
+		for (int si = 0; si < nsub; si++) {
+			for (int li = 0; li < nlu; li++) {
+				offsets[(size_t)si * nlu + li] = total;
+				if (li < (int)newCensus[si].size())
+					total += newCensus[si][li];
+			}
+		}
+		offsets[(size_t)nsub * nlu] = total;
+		cursor.assign(offsets.begin(), offsets.end() - 1);
+		vector <vector <long long> >().swap(census);
 
-	// Sort the value in each lu data
-	void sortHashElevDistSlp() {
-		for (int i = 0; i < totallunos; i++) {
-			if (t[i] != NULL)
-			{
-				sort(t[i]->v->elevarr.begin(), t[i]->v->elevarr.end());
-				sort(t[i]->v->distarr.begin(), t[i]->v->distarr.end());
-				sort(t[i]->v->slparr.begin(), t[i]->v->slparr.end());
-			}
-		}
+		elevbuf.resize(total);
+		distbuf.resize(total);
+		slpbuf.resize(total);
 	}
 
+	// Put the values of one cell into its bucket
+	void addCell(long subno, long luno, float eleval, float distval, float slpval) {
+		long long p = cursor[(size_t)subIdx.find(subno) * nlus() + luIdx.find(luno)]++;
+		elevbuf[p] = eleval;
+		distbuf[p] = distval;
+		slpbuf[p] = slpval;
+	}
 
-	// Calculate the percent values
-	// This function calculates the perctntage over total numbers
-	// It represents the area of one cell covering the subarea.
-	void calPercElevDistSlp() {
-		for (int i = 0; i < totallunos; i++) {
-			if (t[i] != NULL)
-			{
-				float disttp, elevtp, slptp;
-				for (std::vector<float>::size_type di = 0; di != t[i]->v->distarr.size(); di++) {
-					disttp = (float)((float)(di+1.0)*100.0/ t[i]->v->distarr.size());
-					t[i]->v->distperarr.push_back(disttp);
-				}
-				for (std::vector<float>::size_type ei = 0; ei != t[i]->v->elevarr.size(); ei++) {
-					elevtp = (float)((float)(ei + 1.0)*100.0 / t[i]->v->distarr.size());
-					t[i]->v->elevperarr.push_back(elevtp);
-				}
-				for (std::vector<float>::size_type si = 0; si != t[i]->v->slparr.size(); si++) {
-					slptp = (float)((float)(si + 1.0)*100.0 / t[i]->v->slparr.size());
-					t[i]->v->slpperarr.push_back(slptp);
-				}
-
-			}
-		}
+	int nsubs() {
+		return subIdx.size();
 	}
 
-	/*
-	** countTotalCellinSub
-	*/
-	void countTotalCellinSub() {
-
-		int totalcell = 0;
-		
-		for (int i = 0; i < totallunos; i++) {
-			if (t[i] != NULL)
-			{
-				// Initialize the total cell value
-				t[i]->v->totalsubcells = 0;
-				t[i]->v->totallucells = 0;
-				totalcell += t[i]->v->distarr.size();
-				//printf("totalcell : %d, size: %d\n", totalcell, t[i]->v->distarr.size());
-			}
-		}
-		//printf("final talcell : %d\n", totalcell);
-		for (int i = 0; i < totallunos; i++) {
-			if (t[i] != NULL)
-			{
-				t[i]->v->totalsubcells = totalcell;
-				t[i]->v->luareaper = (float)t[i]->v->distarr.size()/(float)totalcell;
-				t[i]->v->totallucells = t[i]->v->distarr.size();
-				//printf("final tal land use cell : %d\n", t[i]->v->totallucells);
-			}
-		}
+	int nlus() {
+		return luIdx.size();
 	}
 
+	size_t nbuckets() {
+		return offsets.empty() ? 0 : offsets.size() - 1;
+	}
 
-	/*
-	** caltrapzarea()
-	**
-	** Calculates the area of a trapozoid shape.
-	** Four inputs are required. In this application:
-	** 1. the x axis value (elevation, distance or slope),
-	**    will be used as height of the shape.
-	** 2. the y axis value (percentage calculated)
-	**    will be used as the top (x) and bottom (x+1).
-	*/
-	float caltrapzarea(float olu1, float olu2, float perlu1, float perlu2)
-	{
-		float traparea = (olu2 - olu1)*(perlu1 + perlu2) / (float)2;
-		return traparea;
-	}
-
-
-
-	// calAccArea
-	// This function calculates the area covered by each
-	// curve of elevper, distper, and slpper of each land use.
-	void calAccAreaLuElevDistSlp() {
-		for (int i = 0; i < totallunos; i++) {
-			if (t[i] != NULL)
-			{		
-				//Initialize the area values
-				t[i]->v->elevarea = 0.0;
-				t[i]->v->distarea = 0.0;
-				t[i]->v->slparea = 0.0;
-
-				if (t[i]->v->distarr.size() == 1) {
-					t[i]->v->distarea = 0.0;
-				}else
-				{
-					for (int di = 1; di < t[i]->v->distarr.size(); di++) 
-					{
-						t[i]->v->distarea += caltrapzarea(
-							t[i]->v->distarr[di-1],
-							t[i]->v->distarr[di],
-							t[i]->v->distperarr[di-1],
-							t[i]->v->distperarr[di]);
-					}
-				}
-
-				if (t[i]->v->elevarr.size() == 1) {
-					t[i]->v->elevarea = 0.0;
-				}
-				else
-				{
-					for (int ei = 1; ei < t[i]->v->elevarr.size(); ei++)
-					{
-						t[i]->v->elevarea += caltrapzarea(
-							t[i]->v->elevarr[ei-1],
-							t[i]->v->elevarr[ei],
-							t[i]->v->elevperarr[ei-1],
-							t[i]->v->elevperarr[ei]);
-					}
-				}
-
-				if (t[i]->v->slparr.size() == 1) {
-					t[i]->v->slparea = 0.0;
-				}
-				else
-				{
-					for (int si = 1; si < t[i]->v->slparr.size(); si++)
-					{
-						t[i]->v->slparea += caltrapzarea(
-							t[i]->v->slparr[si-1],
-							t[i]->v->slparr[si],
-							t[i]->v->slpperarr[si-1],
-							t[i]->v->slpperarr[si]);
-					}
-				}
-			}
-		}
+	long subOf(size_t b) {
+		return subIdx.ids[b / nlus()];
 	}
 
-	bool compare_float(float x, float y, float epsilon = 0.001f) {
-		if (fabs(x - y) < epsilon)
-			return true; //they are same
-		return false; //they are not same
+	long luOf(size_t b) {
+		return luIdx.ids[b % nlus()];
 	}
 
+	long long bucketSize(size_t b) {
+		return offsets[b + 1] - offsets[b];
+	}
 
-	// Remove Duplicates in array
-	// This function removes the duplicates within the 
-	// elev, distance and slope array.
-	void removeVecDuplicates() {
-		for (int i = 0; i < totallunos; i++) {
-			if (t[i] != NULL)
-			{
-				//float rmslpv, rmslpp;
-				//printf("Landuse No: first: %d\n", t[i]->v->thisluno);
-				for (int di = 1; di < t[i]->v->distarr.size(); di++) {
-					if (t[i]->v->distarr[di-1] == t[i]->v->distarr[di])
-					{
-						t[i]->v->distarr.erase(t[i]->v->distarr.begin() + di - 1);
-						t[i]->v->distperarr.erase(t[i]->v->distperarr.begin() + di -1);
-						di--;
-					}
-				}
-				for (int ei = 1; ei < t[i]->v->elevarr.size() ; ei++) {
-					if (t[i]->v->elevarr[ei-1] == t[i]->v->elevarr[ei])
-					{
-						t[i]->v->elevarr.erase(t[i]->v->elevarr.begin() + ei-1);
-						t[i]->v->elevperarr.erase(t[i]->v->elevperarr.begin() + ei-1);
-						ei--;
-					}
-				}
-				for (int si = 1; si < t[i]->v->slparr.size(); si++) {
-					if (compare_float(t[i]->v->slparr[si-1], t[i]->v->slparr[si]))
-					{
-						//printf("Value slope to be removed: %f\n", t[i]->v->slpperarr[si - 1]);
-						//rmslpp = t[i]->v->slpperarr[si - 1];
-						t[i]->v->slparr.erase(t[i]->v->slparr.begin() + (si-1));
-						t[i]->v->slpperarr.erase(t[i]->v->slpperarr.begin() + (si - 1));
-						//t[i]->v->slpperarr.erase(std::remove(t[i]->v->slpperarr.begin(),
-						//	t[i]->v->slpperarr.end(), rmslpp), t[i]->v->slpperarr.end());
-						si--;
-					}
-				}
-			}
-		}
+	float *elev(size_t b) {
+		return &elevbuf[0] + offsets[b];
 	}
 
+	float *dist(size_t b) {
+		return &distbuf[0] + offsets[b];
+	}
 
-	// display the values and vectors within the hash table 
-	void displayHash() {
-		for (int i = 0; i < totallunos; i++) {
-			if (t[i] != NULL)
-			{
-				int subnot = t[i]->v->thissubno;
-				printf("subno: %d...", subnot);
-				int lunot = t[i]->v->thisluno;
-				printf("luno: %d...", lunot);
-
-
-				int slppersize= t[i]->v->slpperarr.size();
-				printf("slppersize: %d...\n", slppersize);
-				//int elevsize = t[i]->v->elevperarr.size();
-				//printf("elevsize: %d\n", elevsize);
-				//int distsize = t[i]->v->distperarr.size();
-				//printf("elevsize: %d\n", distsize);
-
-				//float areap = t[i]->v->luareaper;
-				//printf("areaper: %f\n", areap);
-				//vector <float> temp;
-				//temp = t[i]->v->slpperarr;
-				//displayFloatVector(temp);
-				//temp = t[i]->v->elevarr;
-				//displayFloatVector(temp);
-				//temp = t[i]->v->slparr;
-				//displayFloatVector(temp);
-			}
-		}
+	float *slp(size_t b) {
+		return &slpbuf[0] + offsets[b];
 	}
 
-	void displayFloatVector(vector <float> vec) {
-		for (auto & it : vec)
-		{
-			printf("%f\n", it);
-		
+	// Sort the values in each bucket
+	void sortElevDistSlp() {
+		for (size_t b = 0; b < nbuckets(); b++) {
+			sort(elev(b), elev(b) + bucketSize(b));
+			sort(dist(b), dist(b) + bucketSize(b));
+			sort(slp(b), slp(b) + bucketSize(b));
 		}
 	}
 
-
-	~HashMapTable() {
-		for (int i = 0; i < totallunos; i++) {
-			if (t[i] != NULL)
-				delete t[i];
-			delete[] t;
+	// Build the curves of the non empty buckets of subarea si from
+	// the sorted values, and append them in land use order.
+	void buildSubCurves(int si, vector <Ludata*> &curves) {
+		size_t b0 = (size_t)si * nlus();
+		int totalcell = offsets[b0 + nlus()] - offsets[b0];
+		for (int li = 0; li < nlus(); li++) {
+			size_t b = b0 + li;
+			long long n = bucketSize(b);
+			if (n == 0) continue;
+			Ludata *ludt = new Ludata;
+			ludt->thissubno = subIdx.ids[si];
+			ludt->thisluno = luIdx.ids[li];
+			ludt->totallucells = n;
+			ludt->totalsubcells = totalcell;
+			ludt->luareaper = (float)n / (float)totalcell;
+			ludt->elevarea = buildLorenzCurve(elev(b), n, false, ludt->elevarr, ludt->elevperarr);
+			ludt->distarea = buildLorenzCurve(dist(b), n, false, ludt->distarr, ludt->distperarr);
+			ludt->slparea = buildLorenzCurve(slp(b), n, true, ludt->slparr, ludt->slpperarr);
+			curves.push_back(ludt);
 		}
 	}
 
-	bool checkMissedSubNo() {
-		// Judge whether this subarea is missing
-		bool isMissingSubNo;
-		int hasValueCount = 0;
-		for (int i = 0; i < totallunos; i++) {
-			if (t[i] != NULL) {
-				hasValueCount = hasValueCount + 1;
-			}
-		}
-
-		if (hasValueCount > 0) { isMissingSubNo = false; }
-		else { isMissingSubNo = true; }
-
-		return isMissingSubNo;
-
-		
+	// Build the curves of all subareas, by subarea and then land
+	// use, and free the value buffers.
+	void buildCurves(vector <Ludata*> &curves) {
+		for (int si = 0; si < nsubs(); si++)
+			buildSubCurves(si, curves);
+		freeValues();
 	}
 
-};
-
-
+	void freeValues() {
+		vector <float>().swap(elevbuf);
+		vector <float>().swap(distbuf);
+		vector <float>().swap(slpbuf);
+	}
 
+	void swap(SubLuTable &other) {
+		std::swap(subIdx, other.subIdx);
+		std::swap(luIdx, other.luIdx);
+		census.swap(other.census);
+		offsets.swap(other.offsets);
+		cursor.swap(other.cursor);
+		elevbuf.swap(other.elevbuf);
+		distbuf.swap(other.distbuf);
+		slpbuf.swap(other.slpbuf);
+	}
+};
 
 
 #endif
@@ -42,17 +42,18 @@ email:  qyfeng18@rcees.ac.cn
 #include "linearpart.h"
 #include "createpart.h"
 #include "tiffIO.h"
+#include "initneighbor.h"
 #include <algorithm>
 #include <string.h>
 #include <vector>
 #include <iostream>
 
 #include "lorenzfp.h"
+#include "lorenzreduce.h"
 
-#include "rapidjson/document.h"
-#include "rapidjson/writer.h"
-#include "rapidjson/stringbuffer.h"
-#include "rapidjson/prettywriter.h" // for stringify JSON
+#include "lorenzjson.h"
+#include "lorenzbin.h"
+#include "sslmfpcore.h"
 #include <cstdio>
 #include <assert.h>
 
@@ -60,43 +61,274 @@ email:  qyfeng18@rcees.ac.cn
 #include <stdlib.h>
 
 using namespace std;
-using namespace rapidjson;
 
 
 
 
+// Wait for the first rows of a grid that is read in the background.
+// Grids that are already in memory have no file and are not waited for.
+static void waitRows(tiffIO *f, long numRows)
+{
+	if (f != NULL) f->readWait(numRows);
+}
+
+// Lorenz curves of each subarea and land use from grids that are in
+// memory, or are still read in the background from luf, distf, elevf and
+// slpf when these are not NULL.  flowDir only gives the layout and cell
+// sizes of the grids, ws and lugrid are long grids, distgrid, elevgrid
+// and slpgrid are float grids.  The curves are written to lzpvajson
+// and lzbinfile when these are not empty.  computet is set to the time
+// the curves were computed, before they are written.  Returns 0, or 1
+// on all the processes if an output file could not be written.
+int lorenzSubCurves(tdpartition *flowDir,
+	tdpartition *distgrid,
+	tdpartition *ws,
+	tdpartition *lugrid,
+	tdpartition *elevgrid,
+	tdpartition *slpgrid,
+	tiffIO *luf,
+	tiffIO *distf,
+	tiffIO *elevf,
+	tiffIO *slpf,
+	char *lzpvajson,
+	char *lzbinfile,
+	bool jscompat,
+	double &computet)
+{
+	int rank,size;
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+	int i,j;
+	double tempdxc,tempdyc;
+	long totalX = flowDir->gettotalx();
+	int nx = flowDir->getnx();
+	int ny = flowDir->getny();
+
+	// Census of the cells of each (subarea, land use) pair.
+	// This also finds the subarea and land use ids, the land uses
+	// are kept in the order they are found.
+	SubLuTable subLuData;
+
+	long subno;
+	long luno;
+
+	// The grids are read directly in the loops over the watershed
+	// cells, which are marked once in wsMask.
+	RasterView<int32_t> wsv = partitionView<int32_t>(ws);
+	RasterView<int32_t> luv = partitionView<int32_t>(lugrid);
+	RasterView<float> elevv = partitionView<float>(elevgrid);
+	RasterView<float> distv = partitionView<float>(distgrid);
+	RasterView<float> slpv = partitionView<float>(slpgrid);
+	RowBitmap wsMask;
+	wsMask.build(wsv);
+
+	// Global index of the first cell of each land use
+	vector <long long> luFirstCell;
+	size_t nlus = 0;
+	int gi, gj;
+
+	for (j = 0; j < ny; ++j) {
+		waitRows(luf, j + 1);
+		const int32_t *wsrow = wsv.row(j);
+		const int32_t *lurow = luv.row(j);
+		flowDir->localToGlobal(0, j, gi, gj);
+		for (i = wsMask.first(j); i < nx; i = wsMask.next(j, i)) {
+			subno = wsrow[i];
+			luno = lurow[i];
+			subLuData.count(subno, luno);
+			if (subLuData.luids().size() != nlus) {
+				nlus = subLuData.luids().size();
+				luFirstCell.push_back((long long)gj * totalX + gi + i);
+			}
+		}
+	}
+
+	// With more than one process each one only found the land uses
+	// of its own part of the grid. The tables need to use the same
+	// land use order on every process before merging.
+	vector <long> luids(subLuData.luids());
+	gatherLuIds(luids, luFirstCell);
+	subLuData.setLuOrder(luids);
+
+	// Lay out the buckets and allocate one buffer per variable
+	subLuData.allocate();
+
+
+	// Put data into the table
+	float eleval, distval, slpval;
+	// Global row of the last watershed cell, the cell size of that
+	// row is used for the areas.
+	int lastValidRow = -1;
+
+	for (j = 0; j < ny; ++j) {
+		if (wsMask.rowCount(j) == 0) continue;
+		waitRows(elevf, j + 1);
+		waitRows(distf, j + 1);
+		waitRows(slpf, j + 1);
+		const int32_t *wsrow = wsv.row(j);
+		const int32_t *lurow = luv.row(j);
+		const float *elevrow = elevv.row(j);
+		const float *distrow = distv.row(j);
+		const float *slprow = slpv.row(j);
+
+		// Get the x and y resolution
+		flowDir->getdxdyc(j, tempdxc, tempdyc);
+		flowDir->localToGlobal(0, j, gi, gj);
+		lastValidRow = gj;
+
+		for (i = wsMask.first(j); i < nx; i = wsMask.next(j, i)) {
+			subno = wsrow[i];
+			luno = lurow[i];
+			eleval = elevrow[i];
+			distval = distrow[i];
+			slpval = slprow[i];
+
+			subLuData.addCell(subno, luno, eleval, distval, slpval);
+		}
+	}
+	// Rows without watershed cells were not waited for
+	waitRows(distf, ny);
+	waitRows(elevf, ny);
+	waitRows(slpf, ny);
+
+	// The last loop did not put any information to the missing subarea nos, since
+	// they do not exist in the waterhsed array.
+
+
+	shareLastRowCellSize(lastValidRow, tempdxc, tempdyc);
+
+	// Then, sort the vector data, and calculate percentage.
+	// Each process sorts its own values, the sorted runs are
+	// then merged on the process owning the subarea so the
+	// percentages are calculated over the whole subarea.
+	subLuData.sortElevDistSlp();
+	redistributeSubLuData(subLuData);
+
+	//Stop timer
+	computet = MPI_Wtime();
+
+	// Create and write output file
+	// The curves are written to json format, which
+	// is easier for php processing.
+	// The rapidjson library was used
+	// Reference https://rapidjson.org/
+	// The curves can also be written to a binary file, see lorenzbin.h.
+	// Only rank 0 writes. With one process each subarea is written
+	// as soon as its curves are built, so building the curves is
+	// part of the write time. Otherwise the finished curves are
+	// first collected on rank 0.
+	LorenzJsonFile *lzjs = NULL;
+	LorenzBinFile *lzbin = NULL;
+	int err = 0;
+	if (rank == 0) {
+		if (strlen(lzpvajson) > 0) {
+			lzjs = new LorenzJsonFile(lzpvajson, "Dist2SubOlt", jscompat);
+			if (!lzjs->isOpen()) {
+				printf("Could not open output file %s\n", lzpvajson);
+				fflush(stdout);
+				err = 1;
+			}
+		}
+		if (strlen(lzbinfile) > 0) {
+			lzbin = new LorenzBinFile(lzbinfile, LZBINSUBFILE, tempdxc, tempdyc);
+			if (!lzbin->isOpen()) {
+				printf("Could not open output file %s\n", lzbinfile);
+				fflush(stdout);
+				err = 1;
+			}
+		}
+	}
+
+	// The curves of each subarea and land use, in order
+	// of subarea and then land use.
+	vector <Ludata*> subLuCurves;
+	if (size == 1) {
+		for (int si = 0; si < subLuData.nsubs(); si++) {
+			subLuData.buildSubCurves(si, subLuCurves);
+			if (lzjs != NULL) lzjs->writeSub(subLuCurves, tempdxc, tempdyc);
+			if (lzbin != NULL) lzbin->writeCurves(subLuCurves);
+			for (auto &ludt : subLuCurves)
+				delete ludt;
+			subLuCurves.clear();
+		}
+		subLuData.freeValues();
+	}
+	else {
+		subLuData.buildCurves(subLuCurves);
+
+		// Collect the finished curves on rank 0 for writing
+		gatherSubLuCurves(subLuCurves);
+
+		vector <Ludata*> oneSubCurves;
+		size_t ci = 0;
+		while (ci < subLuCurves.size()) {
+			int thisSubNo = subLuCurves[ci]->thissubno;
+			oneSubCurves.clear();
+			for (; ci < subLuCurves.size() && subLuCurves[ci]->thissubno == thisSubNo; ci++)
+				oneSubCurves.push_back(subLuCurves[ci]);
+			if (lzjs != NULL) lzjs->writeSub(oneSubCurves, tempdxc, tempdyc);
+			if (lzbin != NULL) lzbin->writeCurves(oneSubCurves);
+			for (auto &ludt : oneSubCurves)
+				delete ludt;
+		}
+	}
+	if (lzjs != NULL && lzjs->isOpen() && !lzjs->close()) {
+		printf("Error writing output file %s\n", lzpvajson);
+		fflush(stdout);
+		err = 1;
+	}
+	delete lzjs;
+	if (lzbin != NULL && lzbin->isOpen() && !lzbin->close()) {
+		printf("Error writing output file %s\n", lzbinfile);
+		fflush(stdout);
+		err = 1;
+	}
+	delete lzbin;
+
+	MPI_Bcast(&err, 1, MPI_INT, 0, MCW);
+	return err;
+}
+
 int lorenzSub(char *pfile,
 	char *distfile,
 	char *wsfile,
 	char *lufile,
 	char *elevfile,
 	char *slpfile,
-	char *lzpvajson)
+	char *lzpvajson,
+	char *lzbinfile,
+	bool jscompat,
+	char *outletsfile)
 {
 
+int err = 0;
 MPI_Init(NULL,NULL);{  
 	//  All code within braces so that objects go out of context and destruct before MPI is closed
 	int rank,size;
 	MPI_Comm_rank(MCW,&rank);
 	MPI_Comm_size(MCW,&size);
 	if(rank==0)printf("sslmfpsub version %s\n",TDVERSION);
-	int i,j,in,jn;
-	float tempFloat; 
-	double tempdxc,tempdyc;
-	short tempShort,k;
-	int32_t tempLong;
-	bool finished;
 
  //  Begin timer
     double begint = MPI_Wtime();
 
+	//With -roi only the bounding window of the watershed cells is read and processed
+	if(useRoiWindow) setValidWindow(wsfile);
+
 	//Read Flow Direction header using tiffIO
-	tiffIO pf(pfile, LONG_TYPE);
+	tiffIO pf(pfile, BYTE_TYPE);
 	long totalX = pf.getTotalX();
 	long totalY = pf.getTotalY();
 	double dxA = pf.getdxA();
 	double dyA = pf.getdyA();
 
+	//Balanced stripes are chosen from the valid flow direction cells of each row
+	if(partitionType == BALANCED_PART){
+		vector<long> rowCounts(totalY);
+		pf.validCellsPerRow(&rowCounts[0]);
+		setPartitionRows(&rowCounts[0], totalY);
+	}
+
 	if(rank==0)
 		{
 			float timeestimate=(1.2e-6*totalX*totalY/pow((double) size,0.65))/60+1;  // Time estimate in minutes
@@ -113,7 +345,7 @@ MPI_Init(NULL,NULL);{
 	int xstart, ystart;
 	flowDir->localToGlobal(0, 0, xstart, ystart);
 	flowDir->savedxdyc(pf);
-	pf.read(xstart, ystart, ny, nx, flowDir->getGridPointer());
+	pf.readStart(xstart, ystart, ny, nx, flowDir->getGridPointer());
 
 
 
@@ -127,7 +359,7 @@ MPI_Init(NULL,NULL);{
 		return 1;  //And maybe an unhappy error message
 	}
 	distgrid = CreateNewPartition(distf.getDatatype(), totalX, totalY, dxA, dyA, distf.getNodata());
-	distf.read(xstart, ystart, ny, nx, distgrid->getGridPointer());
+	distf.readStart(xstart, ystart, ny, nx, distgrid->getGridPointer());
 
 	// Read watershed bourndary ws file.
 	tdpartition *ws;
@@ -139,7 +371,7 @@ MPI_Init(NULL,NULL);{
 		return 1;  //And maybe an unhappy error message
 	}
 	ws = CreateNewPartition(wsf.getDatatype(), totalX, totalY, dxA, dyA, wsf.getNodata());
-	wsf.read(xstart, ystart, ny, nx, ws->getGridPointer());
+	wsf.readStart(xstart, ystart, ny, nx, ws->getGridPointer());
 
 	// Read landuse lufile file.
 	tdpartition *lugrid;
@@ -151,7 +383,7 @@ MPI_Init(NULL,NULL);{
 		return 1;  //And maybe an unhappy error message
 	}
 	lugrid = CreateNewPartition(luf.getDatatype(), totalX, totalY, dxA, dyA, luf.getNodata());
-	luf.read(xstart, ystart, ny, nx, lugrid->getGridPointer());
+	luf.readStart(xstart, ystart, ny, nx, lugrid->getGridPointer());
 
 	// Read elevation elevfile.
 	tdpartition *elevgrid;
@@ -163,7 +395,7 @@ MPI_Init(NULL,NULL);{
 		return 1;  //And maybe an unhappy error message
 	}
 	elevgrid = CreateNewPartition(elevf.getDatatype(), totalX, totalY, dxA, dyA, elevf.getNodata());
-	elevf.read(xstart, ystart, ny, nx, elevgrid->getGridPointer());
+	elevf.readStart(xstart, ystart, ny, nx, elevgrid->getGridPointer());
 
 	// Read slope slp file.
 	tdpartition *slpgrid;
@@ -175,615 +407,33 @@ MPI_Init(NULL,NULL);{
 		return 1;  //And maybe an unhappy error message
 	}
 	slpgrid = CreateNewPartition(slpf.getDatatype(), totalX, totalY, dxA, dyA, slpf.getNodata());
-	slpf.read(xstart, ystart, ny, nx, slpgrid->getGridPointer());
+	slpf.readStart(xstart, ystart, ny, nx, slpgrid->getGridPointer());
+
+	// The grids are read in the background. The watershed grid is
+	// needed first, the others are waited for row by row in the
+	// loops below so the loops start while they are still loading.
+	wsf.readWait();
 
 	//Record time reading files
 	double readt = MPI_Wtime();
-   
-	// Get unique subIDs
-	vector <long> subids;
-	vector <long> luids;
-
-	int subno;
-	int lunot;
-	// find the max subid
-	// This is used later to create a vector of data for subareas.
-	// I was planning using hashtable, which converts the key to index.
-	// Basically, hash function converts large numbers to small numbers as index.
-	// Under our situation, the subids range from 0 to max and can be directly used
-	// as the index in the array. However, we need to avoid some non continuous
-	// suids. Instead of using the vector.size(), we got the max subid.
-	int maxsubid = 0;
-
-	for (j = 0; j < ny; ++j) {
-		for (i = 0; i < nx; ++i) {
-			if (!ws->isNodata(i, j))
-			{
-				subno = ws->getData(i, j, tempLong);
-				if (find(subids.begin(), subids.end(), subno) == subids.end())
-				{
-					if (maxsubid < subno) { maxsubid = subno ;}
-					subids.push_back(subno);
-				}
-				lunot = lugrid->getData(i, j, tempLong);
-				if (find(luids.begin(), luids.end(), lunot) == luids.end())
-				{
-					luids.push_back(lunot);
-				}
 
-			}
-		}
+	// With -o only the cells draining to the outlets are kept in the
+	// watershed grid, the census and the curves then skip the others
+	if (strlen(outletsfile) > 0) {
+		pf.readWait();
+		tdpartition *upstream = upstreamOfOutlets(flowDir, pf, outletsfile);
+		keepUpstream(ws, upstream);
+		delete upstream;
 	}
 
-
-
-
-	// Create subLuData
-	// subLuData is a vector with size of maxsubid.
-	// The value of this vector will be a hash table
-	// storing the values for each lu in this subarea.
-	
-	// Here, we have  the number of 
-	sort(subids.begin(), subids.end());
-	//for (auto& subid : subids) {
-	//	printf("SubNo: %d\n", subid);
-	//}
-
-	// subLuData is a vector of HashMaptable,
-	// Each element contains the luNo: luData;
-	// Each LuDATA is a LuData structure.
-	vector <HashMapTable*> subLuData;
-	totallunos = luids.size();
-	//printf("max suid: %d", maxsubid);
-	for (int si = 0; si <= maxsubid; si++)
-	{
-		HashMapTable *tempHash = new HashMapTable;
-		subLuData.push_back(tempHash);
-	}
-
-
-	// Put data into the hastable
-	int luno;
-	float eleval, distval, slpval;
-	int hsSearchRlt;
-
-	for (j = 0; j < ny; ++j) {
-		for (i = 0; i < nx; ++i) {
-			if (!ws->isNodata(i, j))
-			{
-				// Get subNo as index to access vector of hashtable
-				subno = ws->getData(i, j, tempLong);
-
-				// Value of hashtable is a LuData
-				luno = lugrid->getData(i, j, tempLong);
-				eleval = elevgrid->getData(i, j, tempFloat);
-				distval = distgrid->getData(i, j, tempFloat);
-				slpval = slpgrid->getData(i, j, tempFloat);
-
-				// Get the x and y resolution
-				flowDir->getdxdyc(j, tempdxc, tempdyc);
-
-				hsSearchRlt = subLuData[subno]->SearchKey(luno);
-
-				if (hsSearchRlt == (int)-1)
-				{
-					// If the LU key not in the table, insert one
-					Ludata *ludt = new Ludata;
-					ludt->thisluno = luno;
-					ludt->thissubno = subno;
-					subLuData[subno]->Insert(luno, ludt);
-					
-				}
-				subLuData[subno]->getLuData(luno)->elevarr.push_back(eleval);
-				subLuData[subno]->getLuData(luno)->distarr.push_back(distval);
-				subLuData[subno]->getLuData(luno)->slparr.push_back(slpval);
-			}
-		}
-	}
-	// The last loop did not put any information to the missing subarea nos, since
-	// they do not exist in the waterhsed array.
-
-
-	// Then, sort the vector data, and calculate percentage
-	for (auto& subNo : subLuData) {
-		subNo->sortHashElevDistSlp();
-		subNo->calPercElevDistSlp();
-		subNo->countTotalCellinSub();
-		subNo->removeVecDuplicates();
-		subNo->calAccAreaLuElevDistSlp();
-		//subNo->displayHash();
-
-	}
-
-
-
-	//Stop timer
-	double computet = MPI_Wtime();
-
-	// Create and write output files file
-	// There are two files to write:
-	// lzpointfile
-	// lzareafile
-	// I will try to write them to json format, which 
-	// is easier for php processing.
-	// The rapidjson library was used
-	// Reference https://rapidjson.org/
-
-	// Creating the LzPoint JSON file.
-	int jsSubNo, jsLuNo, len;
-	int luTotalCell, subTotalCell; 
-	string tempSubComp;
-	char buffer[90];
-
-	// Structure for LZPoint JSON:
-	// {tempSubNo: { tempLuNO: { tempElevKey: { tempValueKey: [], tempPointKey: []}}}
-	Document subLuESDJson;
-	Document::AllocatorType& allocator = subLuESDJson.GetAllocator();
-	subLuESDJson.SetObject();//Instantialize a doc object
-	assert(subLuESDJson.IsObject());
-
-	for (auto& subluHash : subLuData) {
-
-		// At this time, the subarea nos that are not included in the wsbdy,
-		// need to skip these.
-		//bool missSubno;
-		//missSubno = subluHash->checkMissedSubNo();
-		
-		//if (missSubno) {
-		//	printf("This is a missing subno\n");
-		//}
-		//else { printf("This is not a missing subno\n"); }
-
-		//if (missSubno == false) {
-		//	
-		// Subarea as key Each Subarea has a key and a Object value
-		Value tempSubNoKey;
-		Value tempSubLuESD(kObjectType);
-
-		// A counter to store whether this subarea has value
-		// If not do not add the member because there are some 
-		// subarea no which does not appear in the watershed grid.
-		int hasResultCtr = 0;
-
-		for (auto &luid : luids)
-		{
-			hsSearchRlt = subluHash->SearchKey(luid);
-			
-			if (hsSearchRlt != (int)-1)
-			{
-				hasResultCtr += 1;
-
-				jsSubNo = subluHash->getLuData(luid)->thissubno;
-				jsLuNo = subluHash->getLuData(luid)->thisluno;
-				//printf("SubNo: %d\n", jsSubNo);
-				//printf("LuTEst: %d\n", hsSearchRlt);
-				//////////////////////////////////////////////////////////////
-				// Processing data for LZ Points 
-				// For the first one, tempSubNo is Null.
-				// For the second one, we need to check whether
-				// these lu ESD value are for the same subarea as the first one.
-				if (tempSubNoKey.IsNull())
-				{
-					len = sprintf(buffer, "%d", jsSubNo);
-					tempSubNoKey.SetString(buffer, len, allocator);
-					memset(buffer, 0, sizeof(buffer));
-				}
-				else {
-					len = sprintf(buffer, "%d", jsSubNo);
-					tempSubComp = tempSubNoKey.GetString();
-					// Modify the subarea no if the value are different
-					if (tempSubComp != buffer) {
-						tempSubNoKey.SetString(buffer, len, allocator);
-					}
-				}
-
-				// Layer2: tempLuKey: {}
-				Value tempLuNoKey;
-				len = sprintf(buffer, "%d", jsLuNo);
-				tempLuNoKey.SetString(buffer, len, allocator);
-				memset(buffer, 0, sizeof(buffer));
-
-				// A LuESDObj to store the key and value for elev, dist and slope.
-				Value tempLuESDObj(kObjectType);
-
-				// Processing data from Elevation
-				// Creat Object, Create key for object
-				// Create array, create key for array
-				// Values elevation
-				Value tempElevObj(kObjectType);
-				Value tempElevObjkey;
-				tempElevObjkey.SetString("Elevation", allocator);
-
-				Value tempValObjkeyElev;
-				tempValObjkeyElev.SetString("Value", allocator);
-				Value tempValObjArrElev(kArrayType);
-
-				for (auto & itev : subluHash->getLuData(luid)->elevarr)
-				{
-					Value tempElevVal;
-					len = sprintf(buffer, "%f", itev);
-					tempElevVal.SetString(buffer, len, allocator);
-					memset(buffer, 0, sizeof(buffer));
-					tempValObjArrElev.PushBack(tempElevVal, allocator);
-				}
-				//printf("Addmember 1\n");
-				tempElevObj.AddMember(tempValObjkeyElev, tempValObjArrElev, allocator);
-
-				// Percentage elevation
-				Value tempPerObjkeyElev;
-				tempPerObjkeyElev.SetString("Percent", allocator);
-
-				Value tempPerObjArrElev(kArrayType);
-
-				for (auto & itev : subluHash->getLuData(luid)->elevperarr)
-				{
-					Value tempElevPer;
-					len = sprintf(buffer, "%f", itev);
-					tempElevPer.SetString(buffer, len, allocator);
-					memset(buffer, 0, sizeof(buffer));
-					tempPerObjArrElev.PushBack(tempElevPer, allocator);
-				}
-				//printf("Addmember 2\n");
-				tempElevObj.AddMember(tempPerObjkeyElev, tempPerObjArrElev, allocator);
-
-
-				// Processing data from Distance
-				// Creat Object, Create key for object
-				// Create array, create key for array
-				Value tempDistObj(kObjectType);
-				Value tempDistObjkey;
-				tempDistObjkey.SetString("Dist2SubOlt", allocator);
-
-				Value tempValObjkeyDist;
-				tempValObjkeyDist.SetString("Value", allocator);
-				Value tempValObjArrDist(kArrayType);
-
-				for (auto & itev : subluHash->getLuData(luid)->distarr)
-				{
-					Value tempDistVal;
-					len = sprintf(buffer, "%f", itev);
-					tempDistVal.SetString(buffer, len, allocator);
-					memset(buffer, 0, sizeof(buffer));
-					tempValObjArrDist.PushBack(tempDistVal, allocator);
-				}
-				//printf("Addmember 3\n");
-				tempDistObj.AddMember(tempValObjkeyDist, tempValObjArrDist, allocator);
-
-				// Percentage Distance
-				Value tempPerObjkeyDist;
-				tempPerObjkeyDist.SetString("Percent", allocator);
-				Value tempPerObjArrDist(kArrayType);
-
-				for (auto & itev : subluHash->getLuData(luid)->distperarr)
-				{
-					Value tempDistPer;
-					len = sprintf(buffer, "%f", itev);
-					tempDistPer.SetString(buffer, len, allocator);
-					memset(buffer, 0, sizeof(buffer));
-					tempPerObjArrDist.PushBack(tempDistPer, allocator);
-				}
-				//printf("Addmember 4\n");
-				tempDistObj.AddMember(tempPerObjkeyDist, tempPerObjArrDist, allocator);
-
-
-				// Processing data from Slope
-				// Creat Object, Create key for object
-				// Create array, create key for array
-				Value tempSlpObj(kObjectType);
-				Value tempSlpObjkey;
-				tempSlpObjkey.SetString("Slope", allocator);
-
-				Value tempValObjkeySlp;
-				tempValObjkeySlp.SetString("Value", allocator);
-				Value tempValObjArrSlp(kArrayType);
-
-				for (auto & itev : subluHash->getLuData(luid)->slparr)
-				{
-					Value tempSlpVal;
-					len = sprintf(buffer, "%f", itev);
-					tempSlpVal.SetString(buffer, len, allocator);
-					memset(buffer, 0, sizeof(buffer));
-					tempValObjArrSlp.PushBack(tempSlpVal, allocator);
-				}
-				//printf("Addmember 5\n");
-				tempSlpObj.AddMember(tempValObjkeySlp, tempValObjArrSlp, allocator);
-
-				// Percentage elevation
-				Value tempPerObjkeySlp;
-				tempPerObjkeySlp.SetString("Percent", allocator);
-				Value tempPerObjArrSlp(kArrayType);
-
-				for (auto & itev : subluHash->getLuData(luid)->slpperarr)
-				{
-					Value tempSlpPer;
-					len = sprintf(buffer, "%f", itev);
-					tempSlpPer.SetString(buffer, len, allocator);
-					memset(buffer, 0, sizeof(buffer));
-					tempPerObjArrSlp.PushBack(tempSlpPer, allocator);
-				}
-				//printf("Addmember 6\n");
-				tempSlpObj.AddMember(tempPerObjkeySlp, tempPerObjArrSlp, allocator);
-
-				// Add the Elev Val and Per member to the Elev obj
-				//printf("Addmember 7\n");
-				tempLuESDObj.AddMember(tempElevObjkey, tempElevObj, allocator);
-				tempLuESDObj.AddMember(tempDistObjkey, tempDistObj, allocator);
-				tempLuESDObj.AddMember(tempSlpObjkey, tempSlpObj, allocator);
-
-
-				//////////////////////////////////////////////////////////////
-				// Processing data for LZ area 
-				// {tempSubNo: { tempLuO: {elev: value, dist: value, slp: value, 
-				//							luCellCount: value, luArea: value,
-				//							luAreaPer: value}
-				//				totalSubArea:{totalCellCount: value, totalArea: value}
-				//				}
-
-				Value elevAK;
-				elevAK.SetString("lzAreaElevation", allocator);
-				Value elevAV;
-				len = sprintf(buffer, "%f", subluHash->getLuData(luid)->elevarea);
-				elevAV.SetString(buffer, len, allocator);
-				memset(buffer, 0, sizeof(buffer));
-
-				Value distAK;
-				distAK.SetString("lzAreaDistance", allocator);
-				Value distAV;
-				len = sprintf(buffer, "%f", subluHash->getLuData(luid)->distarea);
-				distAV.SetString(buffer, len, allocator);
-				memset(buffer, 0, sizeof(buffer));
-
-				Value slopeAK;
-				slopeAK.SetString("lzAreaSlope", allocator);
-				Value slopeAV;
-				len = sprintf(buffer, "%f", subluHash->getLuData(luid)->slparea);
-				slopeAV.SetString(buffer, len, allocator);
-				memset(buffer, 0, sizeof(buffer));
-
-				// Total cell count
-				Value tcCK;
-				tcCK.SetString("totalCell", allocator);
-				Value tcCV;
-				len = sprintf(buffer, "%d", subluHash->getLuData(luid)->totallucells);
-				tcCV.SetString(buffer, len, allocator);
-				memset(buffer, 0, sizeof(buffer));
-
-				Value tLuAK;
-				tLuAK.SetString("totalLuArea", allocator);
-				Value tLuAV;
-				len = sprintf(buffer, "%f", float(subluHash->getLuData(luid)->totallucells)*(float)tempdxc*(float)tempdyc / (float)10000.0);
-				tLuAV.SetString(buffer, len, allocator);
-				memset(buffer, 0, sizeof(buffer));
-
-				Value tLuPK;
-				tLuPK.SetString("totalLuAreaPer", allocator);
-				Value tLuPV;
-				len = sprintf(buffer, "%f", (float)subluHash->getLuData(luid)->luareaper);
-				tLuPV.SetString(buffer, len, allocator);
-				memset(buffer, 0, sizeof(buffer));
-
-
-				// A LuESDObj to store the key and value for elev, dist and slope.
-				Value luESDAreaObj(kObjectType);
-				Value luESDAreaObjkey;
-				luESDAreaObjkey.SetString("LULZAreas", allocator);
-				//printf("Addmember 8\n");
-				luESDAreaObj.AddMember(elevAK, elevAV, allocator);
-				luESDAreaObj.AddMember(distAK, distAV, allocator);
-				luESDAreaObj.AddMember(slopeAK, slopeAV, allocator);
-				luESDAreaObj.AddMember(tcCK, tcCV, allocator);
-				luESDAreaObj.AddMember(tLuAK, tLuAV, allocator);
-				luESDAreaObj.AddMember(tLuPK, tLuPV, allocator);
-
-				//totalSubAreaObj.AddMember(totalCellCountK, Value, allocator);
-				//printf("Addmember 9\n");
-				tempLuESDObj.AddMember(luESDAreaObjkey, luESDAreaObj, allocator);
-
-				// After all variables, elev, dist and slp were processed
-				// the data for one lu is finished
-				//printf("Addmember 10\n");
-				tempSubLuESD.AddMember(tempLuNoKey, tempLuESDObj, allocator);
-
-
-				// Blocks to store subareas
-				Value subTotalAreaObj(kObjectType);
-				Value subTotalAreakey;
-				subTotalAreakey.SetString("TotalSubArea", allocator);
-
-				// Check whether the object has the area key.
-				Value::ConstMemberIterator itr = tempSubLuESD.FindMember(subTotalAreakey);
-				if (itr == tempSubLuESD.MemberEnd())
-				{
-					//printf("Do not have this member\n");
-					// There is no total area, Create a value and add it
-					Value subTotalCellKey;
-					subTotalCellKey.SetString("TotalCellCount", allocator);
-					Value subTotalCellVal;
-					len = sprintf(buffer, "%d", subluHash->getLuData(luid)->totalsubcells);
-					subTotalCellVal.SetString(buffer, len, allocator);
-					memset(buffer, 0, sizeof(buffer));
-
-					Value subTotalAreaKey;
-					subTotalAreaKey.SetString("TotalArea", allocator);
-					Value subTotalAreaVal;
-					len = sprintf(buffer, "%f",
-						(float)subluHash->getLuData(luid)->totalsubcells * (float)tempdxc * (float)tempdyc / (float)10000.0);
-					subTotalAreaVal.SetString(buffer, len, allocator);
-					memset(buffer, 0, sizeof(buffer));
-					//printf("Addmember 11\n");
-					subTotalAreaObj.AddMember(subTotalCellKey, subTotalCellVal, allocator);
-					subTotalAreaObj.AddMember(subTotalAreaKey, subTotalAreaVal, allocator);
-					tempSubLuESD.AddMember(subTotalAreakey, subTotalAreaObj, allocator);
-				}
-			}
-		}
-		
-		// If the subarea has more than one result for land use, add the meber to SubluESDJson
-		if (hasResultCtr > 0) {
-			//printf("Addmember 12\n");
-			subLuESDJson.AddMember(tempSubNoKey, tempSubLuESD, allocator);
-		}
-		else { continue; }
-
-	}// End of for loop
-	
-	//printf("\nModified JSON with reformatting:\n");
-	StringBuffer sbsubLuESDJson;
-	PrettyWriter<StringBuffer> writer(sbsubLuESDJson);
-	subLuESDJson.Accept(writer);    // Accept() traverses the DOM and generates Handler events.
-	//printf("%s\n", sbsubLuESDJson.GetString());
-
-	
-	// After getting the sting, write them into the output file
-	FILE* file = fopen(lzpvajson, "wb");
-	if (file)
-	{
-		fputs(sbsubLuESDJson.GetString(), file);
-		fclose(file);
-	}
-
+	// Build and write the curves, the grids still being read
+	// are waited for row by row
+	double computet;
+	err = lorenzSubCurves(flowDir, distgrid, ws, lugrid, elevgrid, slpgrid,
+		&luf, &distf, &elevf, &slpf, lzpvajson, lzbinfile, jscompat, computet);
+	pf.readWait();
 
 	double writet = MPI_Wtime();
-	// The following code were used to write the outputs to
-	// txt files.
-	//FILE *flzpOut;
-	//flzpOut = fopen(lzpointfile, "w");
-	//FILE *flzaout;
-	//flzaout = fopen(lzareafile, "w");
-	
-	// Write head line for lzpoints
-	//fprintf(flzpOut, "subno|luno|var|vartype|values\n");
-	//fprintf(flzaout, "subno|luno|var|areaUnderCurve|areaThisLU|areaPerThisLu|TotalSubcell|TotalsubAreainha\n");
-
-
-	////printf("xy reso: %f, %f", tempdxc, tempdyc);
-
-	//for (auto& subluHash : subLuData) {
-	//	
-	//	for (auto &luid: luids)
-	//	{
-	//		hsSearchRlt = subluHash->SearchKey(luid);
-	//		//printf("LuTEst: %d\n", hsSearchRlt);
-	//		if (hsSearchRlt != (int)-1)
-	//		{
-	//			// Write to LZPoint files
-	//			fprintf(flzpOut, "%d|%d|%s|%s|", 
-	//				subluHash->getLuData(luid)->thissubno,
-	//				subluHash->getLuData(luid)->thisluno,
-	//				"elev", "pointValue"
-	//			);
-	//			for (auto & itev : subluHash->getLuData(luid)->elevarr)
-	//			{
-	//				fprintf(flzpOut, "%f,", itev);
-	//			}
-	//			fprintf(flzpOut, "\n");
-
-	//			fprintf(flzpOut, "%d|%d|%s|%s|",
-	//				subluHash->getLuData(luid)->thissubno,
-	//				subluHash->getLuData(luid)->thisluno,
-	//				"elev", "accumAreaPer"
-	//			);
-	//			for (auto & itep : subluHash->getLuData(luid)->elevperarr)
-	//			{
-	//				fprintf(flzpOut, "%f,", itep);
-	//			}
-	//			fprintf(flzpOut, "\n");
-
-
-	//			fprintf(flzpOut, "%d|%d|%s|%s|",
-	//				subluHash->getLuData(luid)->thissubno,
-	//				subluHash->getLuData(luid)->thisluno,
-	//				"dist2subolt", "pointValue"
-	//			);
-	//			for (auto & itdv : subluHash->getLuData(luid)->distarr)
-	//			{
-	//				fprintf(flzpOut, "%f,", itdv);
-	//			}
-	//			fprintf(flzpOut, "\n");
-
-	//			fprintf(flzpOut, "%d|%d|%s|%s|",
-	//				subluHash->getLuData(luid)->thissubno,
-	//				subluHash->getLuData(luid)->thisluno,
-	//				"dist2subolt", "accumAreaPer"
-	//			);
-	//			for (auto & itdp : subluHash->getLuData(luid)->distperarr)
-	//			{
-	//				fprintf(flzpOut, "%f,", itdp);
-	//			}
-	//			fprintf(flzpOut, "\n");
-
-	//			fprintf(flzpOut, "%d|%d|%s|%s|",
-	//				subluHash->getLuData(luid)->thissubno,
-	//				subluHash->getLuData(luid)->thisluno,
-	//				"slope", "pointValue"
-	//			);
-	//			for (auto & itsv : subluHash->getLuData(luid)->slparr)
-	//			{
-	//				fprintf(flzpOut, "%f,", itsv);
-	//			}
-	//			fprintf(flzpOut, "\n");
-
-	//			fprintf(flzpOut, "%d|%d|%s|%s|",
-	//				subluHash->getLuData(luid)->thissubno,
-	//				subluHash->getLuData(luid)->thisluno,
-	//				"slope", "accumAreaPer"
-	//			);
-	//			for (auto & itsp : subluHash->getLuData(luid)->slpperarr)
-	//			{
-	//				fprintf(flzpOut, "%f,", itsp);
-	//			}
-	//			fprintf(flzpOut, "\n");
-
-	//			// Write to LZArea files
-	//			//subno|luno|var|areaUnderLZCurve|areaThisLUinha|areaPerThisLu|TotalSubcell|TotalsubAreainha\n
-	//			fprintf(flzaout, "%d|%d|%s|%f|%f|%f|%f|%f\n",
-	//				subluHash->getLuData(luid)->thissubno,
-	//				subluHash->getLuData(luid)->thisluno,
-	//				"elev",
-	//				subluHash->getLuData(luid)->elevarea,
-	//				float(subluHash->getLuData(luid)->totallucells)*(float)tempdxc*(float)tempdyc / (float)10000.0,
-	//				(float)subluHash->getLuData(luid)->luareaper,
-	//				(float)subluHash->getLuData(luid)->totalsubcells,
-	//				float(subluHash->getLuData(luid)->totalsubcells) * (float)tempdxc * (float)tempdyc/(float)10000.0
-	//			);
-	//			fprintf(flzaout, "%d|%d|%s|%f|%f|%f|%f|%f\n",
-	//				subluHash->getLuData(luid)->thissubno,
-	//				subluHash->getLuData(luid)->thisluno,
-	//				"dist",
-	//				subluHash->getLuData(luid)->distarea,
-	//				(float)subluHash->getLuData(luid)->totallucells* (float)tempdxc * (float)tempdyc / (float)10000.0,
-	//				(float)subluHash->getLuData(luid)->luareaper,
-	//				(float)subluHash->getLuData(luid)->totalsubcells,
-	//				(float)subluHash->getLuData(luid)->totalsubcells * (float)tempdxc * (float)tempdyc / (float)10000.0
-	//			);
-	//			fprintf(flzaout, "%d|%d|%s|%f|%f|%f|%f|%f\n",
-	//				subluHash->getLuData(luid)->thissubno,
-	//				subluHash->getLuData(luid)->thisluno,
-	//				"slope",
-	//				subluHash->getLuData(luid)->slparea,
-	//				(float)subluHash->getLuData(luid)->totallucells* (float)tempdxc * (float)tempdyc / (float)10000.0,
-	//				(float)subluHash->getLuData(luid)->luareaper,
-	//				(float)subluHash->getLuData(luid)->totalsubcells,
-	//				(float)subluHash->getLuData(luid)->totalsubcells * (float)tempdxc * (float)tempdyc / (float)10000.0
-	//			);
-
-
-
-
-	//		}
-	//	}
-	//}
-
-	//fclose(flzpOut);
-	//fclose(flzaout);
-
-
-
-
-
-
-
-
 
         double dataRead, compute, write, total,tempd;
         dataRead = readt-begint;
@@ -806,6 +456,6 @@ MPI_Init(NULL,NULL);{
 
 	//Brackets force MPI-dependent objects to go out of scope before Finalize is called
 	}MPI_Finalize();
-return(0);
+return(err);
 }
 
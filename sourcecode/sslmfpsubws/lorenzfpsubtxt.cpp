@@ -174,68 +174,37 @@ MPI_Init(NULL,NULL);{
 	//Record time reading files
 	double readt = MPI_Wtime();
    
-	// Get unique subIDs
-	vector <long> subids;
-	vector <long> luids;
-
-	int subno;
-	int lunot;
-	// find the max subid
-	// This is used later to create a vector of data for subareas.
-	// I was planning using hashtable, which converts the key to index.
-	// Basically, hash function converts large numbers to small numbers as index.
-	// Under our situation, the subids range from 0 to max and can be directly used
-	// as the index in the array. However, we need to avoid some non continuous
-	// suids. Instead of using the vector.size(), we got the max subid.
-	int maxsubid = 0;
+	// Census of the cells of each (subarea, land use) pair.
+	// This also finds the subarea and land use ids, the land uses
+	// are kept in the order they are found.
+	SubLuTable subLuData;
+
+	long subno;
+	long luno;
 
 	for (j = 0; j < ny; ++j) {
 		for (i = 0; i < nx; ++i) {
 			if (!ws->isNodata(i, j))
 			{
 				subno = ws->getData(i, j, tempLong);
-				if (find(subids.begin(), subids.end(), subno) == subids.end())
-				{
-					if (maxsubid < subno) { maxsubid = subno ;}
-					subids.push_back(subno);
-				}
-				lunot = lugrid->getData(i, j, tempLong);
-				if (find(luids.begin(), luids.end(), lunot) == luids.end())
-				{
-					luids.push_back(lunot);
-				}
-
+				luno = lugrid->getData(i, j, tempLong);
+				subLuData.count(subno, luno);
 			}
 		}
 	}
 
-
-	// Create subLuData
-	// subLuData is a vector with size of maxsubid.
-	// The value of this vector will be a hash table
-	// storing the values for each lu in this subarea.
-	vector <HashMapTable*> subLuData;
-	totallunos = luids.size();
-	for (int si = 0; si <= maxsubid; si++)
-	{
-		HashMapTable *tempHash = new HashMapTable;
-		subLuData.push_back(tempHash);
-	}
-
+	// Lay out the buckets and allocate one buffer per variable
+	subLuData.allocate();
 
 
-	// Put data into the hastable
-	int luno;
+	// Put data into the table
 	float eleval, distval, slpval;
-	int hsSearchRlt;
 
 	for (j = 0; j < ny; ++j) {
 		for (i = 0; i < nx; ++i) {
 			if (!ws->isNodata(i, j))
 			{
-				// Get subNo as index to access vector of hashtable
 				subno = ws->getData(i, j, tempLong);
-				// Value of hashtable is a LuData
 				luno = lugrid->getData(i, j, tempLong);
 				eleval = elevgrid->getData(i, j, tempFloat);
 				distval = distgrid->getData(i, j, tempFloat);
@@ -244,39 +213,16 @@ MPI_Init(NULL,NULL);{
 				// Get the x and y resolution
 				flowDir->getdxdyc(j, tempdxc, tempdyc);
 
-				hsSearchRlt = subLuData[subno]->SearchKey(luno);
-
-				if (hsSearchRlt == (int)-1)
-				{
-					// If the LU key not in the table, insert one
-					Ludata *ludt = new Ludata;
-					ludt->thisluno = luno;
-					ludt->thissubno = subno;
-					subLuData[subno]->Insert(luno, ludt);
-					
-				}
-				subLuData[subno]->getLuData(luno)->elevarr.push_back(eleval);
-				subLuData[subno]->getLuData(luno)->distarr.push_back(distval);
-				subLuData[subno]->getLuData(luno)->slparr.push_back(slpval);
+				subLuData.addCell(subno, luno, eleval, distval, slpval);
 			}
 		}
 	}
 
-	// See what we got for the structure
-	// Print vector elements 
-	//for (auto& subNo : subLuData) {
-	//	subNo->displayHash();
-	//}
-
 	// Then, sort the vector data, and calculate percentage
-	for (auto& subNo : subLuData) {
-		subNo->sortHashElevDistSlp();
-		subNo->calPercElevDistSlp();
-		subNo->countTotalCellinSub();
-		subNo->removeVecDuplicates();
-		subNo->calAccAreaLuElevDistSlp();
-		//subNo->displayHash();
-	}
+	// The curves are in order of subarea and then land use.
+	subLuData.sortElevDistSlp();
+	vector <Ludata*> subLuCurves;
+	subLuData.buildCurves(subLuCurves);
 
 	//Stop timer
 	double computet = MPI_Wtime();
@@ -604,120 +550,111 @@ MPI_Init(NULL,NULL);{
 
 	//printf("xy reso: %f, %f", tempdxc, tempdyc);
 
-	for (auto& subluHash : subLuData) {
-		
-		for (auto &luid: luids)
+	for (auto &ludt : subLuCurves) {
+		// Write to LZPoint files
+		fprintf(flzpOut, "%d|%d|%s|%s|", 
+			ludt->thissubno,
+			ludt->thisluno,
+			"elev", "pointValue"
+		);
+		for (auto & itev : ludt->elevarr)
 		{
-			hsSearchRlt = subluHash->SearchKey(luid);
-			//printf("LuTEst: %d\n", hsSearchRlt);
-			if (hsSearchRlt != (int)-1)
-			{
-				// Write to LZPoint files
-				fprintf(flzpOut, "%d|%d|%s|%s|", 
-					subluHash->getLuData(luid)->thissubno,
-					subluHash->getLuData(luid)->thisluno,
-					"elev", "pointValue"
-				);
-				for (auto & itev : subluHash->getLuData(luid)->elevarr)
-				{
-					fprintf(flzpOut, "%f,", itev);
-				}
-				fprintf(flzpOut, "\n");
-
-				fprintf(flzpOut, "%d|%d|%s|%s|",
-					subluHash->getLuData(luid)->thissubno,
-					subluHash->getLuData(luid)->thisluno,
-					"elev", "accumAreaPer"
-				);
-				for (auto & itep : subluHash->getLuData(luid)->elevperarr)
-				{
-					fprintf(flzpOut, "%f,", itep);
-				}
-				fprintf(flzpOut, "\n");
-
-
-				fprintf(flzpOut, "%d|%d|%s|%s|",
-					subluHash->getLuData(luid)->thissubno,
-					subluHash->getLuData(luid)->thisluno,
-					"dist2subolt", "pointValue"
-				);
-				for (auto & itdv : subluHash->getLuData(luid)->distarr)
-				{
-					fprintf(flzpOut, "%f,", itdv);
-				}
-				fprintf(flzpOut, "\n");
-
-				fprintf(flzpOut, "%d|%d|%s|%s|",
-					subluHash->getLuData(luid)->thissubno,
-					subluHash->getLuData(luid)->thisluno,
-					"dist2subolt", "accumAreaPer"
-				);
-				for (auto & itdp : subluHash->getLuData(luid)->distperarr)
-				{
-					fprintf(flzpOut, "%f,", itdp);
-				}
-				fprintf(flzpOut, "\n");
-
-				fprintf(flzpOut, "%d|%d|%s|%s|",
-					subluHash->getLuData(luid)->thissubno,
-					subluHash->getLuData(luid)->thisluno,
-					"slope", "pointValue"
-				);
-				for (auto & itsv : subluHash->getLuData(luid)->slparr)
-				{
-					fprintf(flzpOut, "%f,", itsv);
-				}
-				fprintf(flzpOut, "\n");
-
-				fprintf(flzpOut, "%d|%d|%s|%s|",
-					subluHash->getLuData(luid)->thissubno,
-					subluHash->getLuData(luid)->thisluno,
-					"slope", "accumAreaPer"
-				);
-				for (auto & itsp : subluHash->getLuData(luid)->slpperarr)
-				{
-					fprintf(flzpOut, "%f,", itsp);
-				}
-				fprintf(flzpOut, "\n");
-
-				// Write to LZArea files
-				//subno|luno|var|areaUnderLZCurve|areaThisLUinha|areaPerThisLu|TotalSubcell|TotalsubAreainha\n
-				fprintf(flzaout, "%d|%d|%s|%f|%f|%f|%f|%f\n",
-					subluHash->getLuData(luid)->thissubno,
-					subluHash->getLuData(luid)->thisluno,
-					"elev",
-					subluHash->getLuData(luid)->elevarea,
-					float(subluHash->getLuData(luid)->totallucells)*(float)tempdxc*(float)tempdyc / (float)10000.0,
-					(float)subluHash->getLuData(luid)->luareaper,
-					(float)subluHash->getLuData(luid)->totalsubcells,
-					float(subluHash->getLuData(luid)->totalsubcells) * (float)tempdxc * (float)tempdyc/(float)10000.0
-				);
-				fprintf(flzaout, "%d|%d|%s|%f|%f|%f|%f|%f\n",
-					subluHash->getLuData(luid)->thissubno,
-					subluHash->getLuData(luid)->thisluno,
-					"dist",
-					subluHash->getLuData(luid)->distarea,
-					(float)subluHash->getLuData(luid)->totallucells* (float)tempdxc * (float)tempdyc / (float)10000.0,
-					(float)subluHash->getLuData(luid)->luareaper,
-					(float)subluHash->getLuData(luid)->totalsubcells,
-					(float)subluHash->getLuData(luid)->totalsubcells * (float)tempdxc * (float)tempdyc / (float)10000.0
-				);
-				fprintf(flzaout, "%d|%d|%s|%f|%f|%f|%f|%f\n",
-					subluHash->getLuData(luid)->thissubno,
-					subluHash->getLuData(luid)->thisluno,
-					"slope",
-					subluHash->getLuData(luid)->slparea,
-					(float)subluHash->getLuData(luid)->totallucells* (float)tempdxc * (float)tempdyc / (float)10000.0,
-					(float)subluHash->getLuData(luid)->luareaper,
-					(float)subluHash->getLuData(luid)->totalsubcells,
-					(float)subluHash->getLuData(luid)->totalsubcells * (float)tempdxc * (float)tempdyc / (float)10000.0
-				);
+			fprintf(flzpOut, "%f,", itev);
+		}
+		fprintf(flzpOut, "\n");
+
+		fprintf(flzpOut, "%d|%d|%s|%s|",
+			ludt->thissubno,
+			ludt->thisluno,
+			"elev", "accumAreaPer"
+		);
+		for (auto & itep : ludt->elevperarr)
+		{
+			fprintf(flzpOut, "%f,", itep);
+		}
+		fprintf(flzpOut, "\n");
+
+
+		fprintf(flzpOut, "%d|%d|%s|%s|",
+			ludt->thissubno,
+			ludt->thisluno,
+			"dist2subolt", "pointValue"
+		);
+		for (auto & itdv : ludt->distarr)
+		{
+			fprintf(flzpOut, "%f,", itdv);
+		}
+		fprintf(flzpOut, "\n");
+
+		fprintf(flzpOut, "%d|%d|%s|%s|",
+			ludt->thissubno,
+			ludt->thisluno,
+			"dist2subolt", "accumAreaPer"
+		);
+		for (auto & itdp : ludt->distperarr)
+		{
+			fprintf(flzpOut, "%f,", itdp);
+		}
+		fprintf(flzpOut, "\n");
+
+		fprintf(flzpOut, "%d|%d|%s|%s|",
+			ludt->thissubno,
+			ludt->thisluno,
+			"slope", "pointValue"
+		);
+		for (auto & itsv : ludt->slparr)
+		{
+			fprintf(flzpOut, "%f,", itsv);
+		}
+		fprintf(flzpOut, "\n");
+
+		fprintf(flzpOut, "%d|%d|%s|%s|",
+			ludt->thissubno,
+			ludt->thisluno,
+			"slope", "accumAreaPer"
+		);
+		for (auto & itsp : ludt->slpperarr)
+		{
+			fprintf(flzpOut, "%f,", itsp);
+		}
+		fprintf(flzpOut, "\n");
+
+		// Write to LZArea files
+		//subno|luno|var|areaUnderLZCurve|areaThisLUinha|areaPerThisLu|TotalSubcell|TotalsubAreainha\n
+		fprintf(flzaout, "%d|%d|%s|%f|%f|%f|%f|%f\n",
+			ludt->thissubno,
+			ludt->thisluno,
+			"elev",
+			ludt->elevarea,
+			float(ludt->totallucells)*(float)tempdxc*(float)tempdyc / (float)10000.0,
+			(float)ludt->luareaper,
+			(float)ludt->totalsubcells,
+			float(ludt->totalsubcells) * (float)tempdxc * (float)tempdyc/(float)10000.0
+		);
+		fprintf(flzaout, "%d|%d|%s|%f|%f|%f|%f|%f\n",
+			ludt->thissubno,
+			ludt->thisluno,
+			"dist",
+			ludt->distarea,
+			(float)ludt->totallucells* (float)tempdxc * (float)tempdyc / (float)10000.0,
+			(float)ludt->luareaper,
+			(float)ludt->totalsubcells,
+			(float)ludt->totalsubcells * (float)tempdxc * (float)tempdyc / (float)10000.0
+		);
+		fprintf(flzaout, "%d|%d|%s|%f|%f|%f|%f|%f\n",
+			ludt->thissubno,
+			ludt->thisluno,
+			"slope",
+			ludt->slparea,
+			(float)ludt->totallucells* (float)tempdxc * (float)tempdyc / (float)10000.0,
+			(float)ludt->luareaper,
+			(float)ludt->totalsubcells,
+			(float)ludt->totalsubcells * (float)tempdxc * (float)tempdyc / (float)10000.0
+		);
 
 
 
 
-			}
-		}
 	}
 
 	fclose(flzpOut);
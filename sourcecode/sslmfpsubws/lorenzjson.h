@@ -0,0 +1,259 @@
+/*  lorenzjson header
+
+  Writes the Lorenz curves to the json output of lorenzfpsub and
+  lorenzfpws. The curves are streamed to the file with a rapidjson
+  Writer over a FileWriteStream, one subarea at a time, so the whole
+  document is never held in memory.
+
+  By default values are written as json numbers. With the
+  compatibility option the previous layout is kept: indented, with
+  every value written as a "%f" formatted string.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email: qyfeng18@rcees.ac.cn
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "lorenzfp.h"
+
+#include "rapidjson/writer.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/filewritestream.h"
+
+using namespace std;
+
+#ifndef LORENZJSON_H
+#define LORENZJSON_H
+
+#define LZJSBUFSIZE 65536
+
+/*
+** LorenzJsonFile
+**
+** Structure of the subarea file (lorenzfpsub):
+** {subNo: {luNo: {Elevation: {Value: [], Percent: []},
+**                 <distKey>: {Value: [], Percent: []},
+**                 Slope: {Value: [], Percent: []},
+**                 LULZAreas: {lzAreaElevation, lzAreaDistance, lzAreaSlope,
+**                             totalCell, totalLuArea, totalLuAreaPer}},
+**          TotalSubArea: {TotalCellCount, TotalArea},
+**          luNo: {...}, ...}, ...}
+** TotalSubArea follows the first land use of each subarea.
+**
+** Structure of the watershed file (lorenzfpws):
+** {luNo: {Elevation, <distKey>, Slope, LULZAreas, TotalSubArea}, ...}
+*/
+class LorenzJsonFile {
+private:
+	FILE *fp;
+	char *streamBuffer;
+	rapidjson::FileWriteStream *os;
+	typedef rapidjson::Writer<rapidjson::FileWriteStream> NumWriter;
+	typedef rapidjson::PrettyWriter<rapidjson::FileWriteStream> CompatWriter;
+	NumWriter *writer;
+	CompatWriter *pwriter;
+	bool compat;
+	bool ok;              // false once a write failed
+	const char *distKey;
+	char buffer[90];
+
+	template <typename W> void writeInt(W &w, int v) {
+		if (compat) {
+			int len = sprintf(buffer, "%d", v);
+			w.String(buffer, len);
+		}
+		else w.Int(v);
+	}
+
+	template <typename W> void writeFloat(W &w, float v) {
+		if (compat) {
+			int len = sprintf(buffer, "%f", v);
+			w.String(buffer, len);
+		}
+		else if (!isfinite(v)) w.Null();
+		else {
+			// Shortest form that reads back as the same float
+			int len = 0;
+			for (int prec = 6; prec <= 9; prec++) {
+				len = sprintf(buffer, "%.*g", prec, v);
+				if (strtof(buffer, NULL) == v) break;
+			}
+			w.RawValue(buffer, len, rapidjson::kNumberType);
+		}
+	}
+
+	template <typename W> void writeIdKey(W &w, int id) {
+		int len = sprintf(buffer, "%d", id);
+		w.Key(buffer, len);
+	}
+
+	template <typename W> void writeCurve(W &w, const char *key, vector <float> &valarr, vector <float> &perarr) {
+		w.Key(key);
+		w.StartObject();
+		w.Key("Value");
+		w.StartArray();
+		for (auto &v : valarr)
+			writeFloat(w, v);
+		w.EndArray();
+		w.Key("Percent");
+		w.StartArray();
+		for (auto &v : perarr)
+			writeFloat(w, v);
+		w.EndArray();
+		w.EndObject();
+	}
+
+	template <typename W> void writeLu(W &w, Ludata *ludt, double dxc, double dyc) {
+		writeCurve(w, "Elevation", ludt->elevarr, ludt->elevperarr);
+		writeCurve(w, distKey, ludt->distarr, ludt->distperarr);
+		writeCurve(w, "Slope", ludt->slparr, ludt->slpperarr);
+
+		w.Key("LULZAreas");
+		w.StartObject();
+		w.Key("lzAreaElevation");
+		writeFloat(w, ludt->elevarea);
+		w.Key("lzAreaDistance");
+		writeFloat(w, ludt->distarea);
+		w.Key("lzAreaSlope");
+		writeFloat(w, ludt->slparea);
+		w.Key("totalCell");
+		writeInt(w, ludt->totallucells);
+		w.Key("totalLuArea");
+		writeFloat(w, float(ludt->totallucells)*(float)dxc*(float)dyc / (float)10000.0);
+		w.Key("totalLuAreaPer");
+		writeFloat(w, (float)ludt->luareaper);
+		w.EndObject();
+	}
+
+	template <typename W> void writeSubTotal(W &w, Ludata *ludt, double dxc, double dyc) {
+		w.Key("TotalSubArea");
+		w.StartObject();
+		w.Key("TotalCellCount");
+		writeInt(w, ludt->totalsubcells);
+		w.Key("TotalArea");
+		writeFloat(w, (float)ludt->totalsubcells * (float)dxc * (float)dyc / (float)10000.0);
+		w.EndObject();
+	}
+
+	template <typename W> void writeSubT(W &w, vector <Ludata*> &subCurves, double dxc, double dyc) {
+		if (subCurves.empty()) return;
+		writeIdKey(w, subCurves[0]->thissubno);
+		w.StartObject();
+		for (size_t li = 0; li < subCurves.size(); li++) {
+			writeIdKey(w, subCurves[li]->thisluno);
+			w.StartObject();
+			writeLu(w, subCurves[li], dxc, dyc);
+			w.EndObject();
+			if (li == 0)
+				writeSubTotal(w, subCurves[li], dxc, dyc);
+		}
+		w.EndObject();
+	}
+
+	template <typename W> void writeWsT(W &w, vector <Ludata*> &curves, double dxc, double dyc) {
+		for (auto &ludt : curves) {
+			writeIdKey(w, ludt->thisluno);
+			w.StartObject();
+			writeLu(w, ludt, dxc, dyc);
+			writeSubTotal(w, ludt, dxc, dyc);
+			w.EndObject();
+		}
+	}
+
+public:
+	LorenzJsonFile(const char *fname, const char *distKeyName, bool compatLayout) {
+		compat = compatLayout;
+		distKey = distKeyName;
+		os = NULL;
+		writer = NULL;
+		pwriter = NULL;
+		streamBuffer = NULL;
+		fp = fopen(fname, "wb");
+		ok = fp != NULL;
+		if (fp == NULL)
+			return;
+		streamBuffer = new char[LZJSBUFSIZE];
+		os = new rapidjson::FileWriteStream(fp, streamBuffer, LZJSBUFSIZE);
+		if (compat) {
+			pwriter = new CompatWriter(*os);
+			pwriter->StartObject();
+		}
+		else {
+			writer = new NumWriter(*os);
+			writer->StartObject();
+		}
+	}
+
+	bool isOpen() {
+		return fp != NULL;
+	}
+
+	// Write all the land uses of one subarea
+	void writeSub(vector <Ludata*> &subCurves, double dxc, double dyc) {
+		if (fp == NULL) return;
+		if (compat) writeSubT(*pwriter, subCurves, dxc, dyc);
+		else writeSubT(*writer, subCurves, dxc, dyc);
+	}
+
+	// Write the land uses of the whole watershed
+	void writeWs(vector <Ludata*> &curves, double dxc, double dyc) {
+		if (fp == NULL) return;
+		if (compat) writeWsT(*pwriter, curves, dxc, dyc);
+		else writeWsT(*writer, curves, dxc, dyc);
+	}
+
+	// End the json and close the file. Returns false if the file
+	// could not be opened or any write to it failed.
+	bool close() {
+		if (fp == NULL) return ok;
+		if (compat) pwriter->EndObject();
+		else writer->EndObject();
+		os->Flush();
+		if (ferror(fp))
+			ok = false;
+		if (fclose(fp) != 0)
+			ok = false;
+		fp = NULL;
+		return ok;
+	}
+
+	~LorenzJsonFile() {
+		close();
+		delete writer;
+		delete pwriter;
+		delete os;
+		delete[] streamBuffer;
+	}
+};
+
+#endif
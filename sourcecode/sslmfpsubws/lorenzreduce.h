@@ -0,0 +1,390 @@
+/*  lorenzreduce header
+
+  Functions to combine the (subarea, land use) values collected by
+  each process of lorenzfpsub. Every process sorts the values of its
+  own partition, the sorted runs are sent to the process owning the
+  subarea and merged there before the percent and area calculation.
+  The finished curves are then gathered on rank 0 for writing.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email: qyfeng18@rcees.ac.cn
+*/
+
+#include <mpi.h>
+#include <limits.h>
+#include <queue>
+#include <vector>
+#include <algorithm>
+#include "commonLib.h"
+#include "lorenzfp.h"
+
+using namespace std;
+
+#ifndef LORENZREDUCE_H
+#define LORENZREDUCE_H
+
+// The process that merges and computes the curves of a subarea
+inline int subOwnerRank(int subno, int size)
+{
+	return ((subno % size) + size) % size;
+}
+
+
+// Collect the land use ids found by all processes.
+// The ids are kept in the order they are first met when
+// scanning the grid from the top row, which is the order
+// a single process run would have found them in.
+// firstCell gives for each local id the global index
+// (row * totalX + column) of the first cell it was found in.
+void gatherLuIds(vector <long> &luids, vector <long long> &firstCell)
+{
+	int rank, size;
+	MPI_Comm_rank(MCW, &rank);
+	MPI_Comm_size(MCW, &size);
+	if (size <= 1) return;
+
+	int nlocal = luids.size();
+	vector <int> counts(size), displs(size);
+	MPI_Allgather(&nlocal, 1, MPI_INT, &counts[0], 1, MPI_INT, MCW);
+	int ntotal = 0;
+	for (int r = 0; r < size; r++) {
+		displs[r] = ntotal;
+		ntotal += counts[r];
+	}
+
+	vector <long> sendIds(luids.begin(), luids.end());
+	vector <long> allIds(ntotal > 0 ? ntotal : 1);
+	MPI_Allgatherv(sendIds.empty() ? NULL : &sendIds[0], nlocal, MPI_LONG,
+		&allIds[0], &counts[0], &displs[0], MPI_LONG, MCW);
+	vector <long long> allFirst(ntotal > 0 ? ntotal : 1);
+	MPI_Allgatherv(firstCell.empty() ? NULL : &firstCell[0], nlocal, MPI_LONG_LONG,
+		&allFirst[0], &counts[0], &displs[0], MPI_LONG_LONG, MCW);
+
+	// Order by first cell, an id found by several processes
+	// takes the place of its first cell over all of them
+	vector <pair <long long, long> > order(ntotal);
+	for (int li = 0; li < ntotal; li++)
+		order[li] = make_pair(allFirst[li], allIds[li]);
+	sort(order.begin(), order.end());
+
+	luids.clear();
+	for (int li = 0; li < ntotal; li++) {
+		if (find(luids.begin(), luids.end(), order[li].second) == luids.end())
+			luids.push_back(order[li].second);
+	}
+}
+
+
+// Merge k sorted runs of floats into out.
+// Each run is given as the begin and end pointer.
+struct mergeHead {
+	float val;
+	int run;
+	bool operator>(const mergeHead &other) const { return val > other.val; }
+};
+
+void mergeSortedRuns(vector <const float*> &runBegin, vector <const float*> &runEnd, float *out)
+{
+	if (runBegin.size() == 1) {
+		copy(runBegin[0], runEnd[0], out);
+		return;
+	}
+
+	vector <const float*> cur(runBegin);
+	priority_queue <mergeHead, vector <mergeHead>, greater <mergeHead> > heads;
+	mergeHead h;
+	for (size_t r = 0; r < cur.size(); r++) {
+		if (cur[r] != runEnd[r]) {
+			h.val = *cur[r];
+			h.run = r;
+			heads.push(h);
+		}
+	}
+	while (!heads.empty()) {
+		h = heads.top();
+		heads.pop();
+		*out++ = h.val;
+		if (++cur[h.run] != runEnd[h.run]) {
+			h.val = *cur[h.run];
+			heads.push(h);
+		}
+	}
+}
+
+
+// Convert a per destination count to the displacements used by
+// MPI_Alltoallv/MPI_Gatherv.  Aborts if the buffer does not fit the
+// int counts used by MPI.  gather is true when the buffer is gathered
+// on one process, where more processes do not make it smaller.
+void countsToDispls(vector <long long> &counts, vector <int> &icounts, vector <int> &displs, bool gather = false)
+{
+	long long total = 0;
+	icounts.resize(counts.size());
+	displs.resize(counts.size());
+	for (size_t r = 0; r < counts.size(); r++) {
+		if (counts[r] >= INT_MAX - total) {
+			if (gather)
+				printf("Lorenz data gathered on process 0 exceeds the MPI message size limit.\n");
+			else
+				printf("Lorenz data exchange exceeds the MPI message size limit, use more processes.\n");
+			fflush(stdout);
+			MPI_Abort(MCW, 31);
+		}
+		icounts[r] = (int)counts[r];
+		displs[r] = (int)total;
+		total += counts[r];
+	}
+}
+
+
+// Send the locally sorted buckets of every (subarea, land use)
+// to the process owning the subarea, and merge them there.
+// subLuData must be allocated, filled and sorted, with the global
+// land use order set. On return it only holds the subareas owned by
+// this process, with the values of each bucket sorted.
+//
+// The runs are packed in bucket order, by subarea and then land use.
+// The receiving process walks the packets from all senders at the
+// same time so runs of the same bucket are merged without a lookup.
+void redistributeSubLuData(SubLuTable &subLuData)
+{
+	int rank, size;
+	MPI_Comm_rank(MCW, &rank);
+	MPI_Comm_size(MCW, &size);
+	if (size <= 1) return;
+
+	int nlu = subLuData.nlus();
+	vector <long> luids(subLuData.luids());
+
+	// Count what goes to each process
+	vector <long long> icnt(size, 0), fcnt(size, 0);
+	for (size_t b = 0; b < subLuData.nbuckets(); b++) {
+		if (subLuData.bucketSize(b) == 0) continue;
+		int dest = subOwnerRank(subLuData.subOf(b), size);
+		icnt[dest] += 3;
+		fcnt[dest] += 3 * subLuData.bucketSize(b);
+	}
+
+	vector <int> isendcnt, isenddsp, fsendcnt, fsenddsp;
+	countsToDispls(icnt, isendcnt, isenddsp);
+	countsToDispls(fcnt, fsendcnt, fsenddsp);
+
+	vector <int> isendbuf(isenddsp[size - 1] + isendcnt[size - 1] + 1);
+	vector <float> fsendbuf(fsenddsp[size - 1] + fsendcnt[size - 1] + 1);
+	vector <int> ipos(isenddsp), fpos(fsenddsp);
+
+	for (size_t b = 0; b < subLuData.nbuckets(); b++) {
+		int n = subLuData.bucketSize(b);
+		if (n == 0) continue;
+		int dest = subOwnerRank(subLuData.subOf(b), size);
+		isendbuf[ipos[dest]++] = subLuData.subOf(b);
+		isendbuf[ipos[dest]++] = b % nlu;
+		isendbuf[ipos[dest]++] = n;
+		copy(subLuData.elev(b), subLuData.elev(b) + n, fsendbuf.begin() + fpos[dest]);
+		copy(subLuData.dist(b), subLuData.dist(b) + n, fsendbuf.begin() + fpos[dest] + n);
+		copy(subLuData.slp(b), subLuData.slp(b) + n, fsendbuf.begin() + fpos[dest] + 2 * n);
+		fpos[dest] += 3 * n;
+	}
+
+	// Exchange the counts and then the packets
+	vector <int> irecvcnt(size), frecvcnt(size), irecvdsp(size), frecvdsp(size);
+	MPI_Alltoall(&isendcnt[0], 1, MPI_INT, &irecvcnt[0], 1, MPI_INT, MCW);
+	MPI_Alltoall(&fsendcnt[0], 1, MPI_INT, &frecvcnt[0], 1, MPI_INT, MCW);
+	vector <long long> lcnt(size);
+	for (int r = 0; r < size; r++) lcnt[r] = irecvcnt[r];
+	countsToDispls(lcnt, irecvcnt, irecvdsp);
+	for (int r = 0; r < size; r++) lcnt[r] = frecvcnt[r];
+	countsToDispls(lcnt, frecvcnt, frecvdsp);
+
+	vector <int> irecvbuf(irecvdsp[size - 1] + irecvcnt[size - 1] + 1);
+	vector <float> frecvbuf(frecvdsp[size - 1] + frecvcnt[size - 1] + 1);
+	MPI_Alltoallv(&isendbuf[0], &isendcnt[0], &isenddsp[0], MPI_INT,
+		&irecvbuf[0], &irecvcnt[0], &irecvdsp[0], MPI_INT, MCW);
+	MPI_Alltoallv(&fsendbuf[0], &fsendcnt[0], &fsenddsp[0], MPI_FLOAT,
+		&frecvbuf[0], &frecvcnt[0], &frecvdsp[0], MPI_FLOAT, MCW);
+	vector <int>().swap(isendbuf);
+	vector <float>().swap(fsendbuf);
+
+	// Build the table of the owned subareas from the packet headers
+	SubLuTable owned;
+	owned.setLuOrder(luids);
+	for (int r = 0; r < size; r++) {
+		for (int ic = irecvdsp[r]; ic < irecvdsp[r] + irecvcnt[r]; ic += 3)
+			owned.count(irecvbuf[ic], luids[irecvbuf[ic + 1]], irecvbuf[ic + 2]);
+	}
+	owned.allocate();
+	subLuData.swap(owned);
+	owned = SubLuTable();
+
+	// k-way merge of the runs received for each bucket
+	vector <int> icur(irecvdsp), fcur(frecvdsp);
+	vector <const float*> eBegin, eEnd, dBegin, dEnd, sBegin, sEnd;
+	for (size_t b = 0; b < subLuData.nbuckets(); b++) {
+		if (subLuData.bucketSize(b) == 0) continue;
+		int si = subLuData.subOf(b);
+		int li = b % nlu;
+		eBegin.clear(); eEnd.clear();
+		dBegin.clear(); dEnd.clear();
+		sBegin.clear(); sEnd.clear();
+		for (int r = 0; r < size; r++) {
+			int ic = icur[r];
+			if (ic < irecvdsp[r] + irecvcnt[r] && irecvbuf[ic] == si && irecvbuf[ic + 1] == li) {
+				int n = irecvbuf[ic + 2];
+				const float *f = &frecvbuf[0] + fcur[r];
+				eBegin.push_back(f);         eEnd.push_back(f + n);
+				dBegin.push_back(f + n);     dEnd.push_back(f + 2 * n);
+				sBegin.push_back(f + 2 * n); sEnd.push_back(f + 3 * n);
+				icur[r] += 3;
+				fcur[r] += 3 * n;
+			}
+		}
+		mergeSortedRuns(eBegin, eEnd, subLuData.elev(b));
+		mergeSortedRuns(dBegin, dEnd, subLuData.dist(b));
+		mergeSortedRuns(sBegin, sEnd, subLuData.slp(b));
+	}
+}
+
+
+// Gather the finished curves of all subareas on rank 0, in order
+// of subarea and land use.  Other processes are left with no curves.
+void gatherSubLuCurves(vector <Ludata*> &curves)
+{
+	int rank, size;
+	MPI_Comm_rank(MCW, &rank);
+	MPI_Comm_size(MCW, &size);
+	if (size <= 1) return;
+
+	const int nint = 7;    // subno, luno, 3 curve lengths, lu cells, sub cells
+	const int nfloat = 4;  // 3 curve areas, lu area fraction
+
+	vector <int> isendbuf;
+	vector <float> fsendbuf;
+	if (rank != 0) {
+		for (auto &ludt : curves) {
+			isendbuf.push_back(ludt->thissubno);
+			isendbuf.push_back(ludt->thisluno);
+			isendbuf.push_back(ludt->elevarr.size());
+			isendbuf.push_back(ludt->distarr.size());
+			isendbuf.push_back(ludt->slparr.size());
+			isendbuf.push_back(ludt->totallucells);
+			isendbuf.push_back(ludt->totalsubcells);
+			fsendbuf.push_back(ludt->elevarea);
+			fsendbuf.push_back(ludt->distarea);
+			fsendbuf.push_back(ludt->slparea);
+			fsendbuf.push_back(ludt->luareaper);
+			fsendbuf.insert(fsendbuf.end(), ludt->elevarr.begin(), ludt->elevarr.end());
+			fsendbuf.insert(fsendbuf.end(), ludt->elevperarr.begin(), ludt->elevperarr.end());
+			fsendbuf.insert(fsendbuf.end(), ludt->distarr.begin(), ludt->distarr.end());
+			fsendbuf.insert(fsendbuf.end(), ludt->distperarr.begin(), ludt->distperarr.end());
+			fsendbuf.insert(fsendbuf.end(), ludt->slparr.begin(), ludt->slparr.end());
+			fsendbuf.insert(fsendbuf.end(), ludt->slpperarr.begin(), ludt->slpperarr.end());
+			delete ludt;
+		}
+		curves.clear();
+	}
+
+	long long isendsize = isendbuf.size(), fsendsize = fsendbuf.size();
+	vector <long long> icnt(size), fcnt(size);
+	MPI_Gather(&isendsize, 1, MPI_LONG_LONG, &icnt[0], 1, MPI_LONG_LONG, 0, MCW);
+	MPI_Gather(&fsendsize, 1, MPI_LONG_LONG, &fcnt[0], 1, MPI_LONG_LONG, 0, MCW);
+
+	vector <int> irecvcnt, irecvdsp, frecvcnt, frecvdsp;
+	vector <int> irecvbuf(1);
+	vector <float> frecvbuf(1);
+	if (rank == 0) {
+		countsToDispls(icnt, irecvcnt, irecvdsp, true);
+		countsToDispls(fcnt, frecvcnt, frecvdsp, true);
+		irecvbuf.resize(irecvdsp[size - 1] + irecvcnt[size - 1] + 1);
+		frecvbuf.resize(frecvdsp[size - 1] + frecvcnt[size - 1] + 1);
+	}
+	isendbuf.push_back(0);
+	fsendbuf.push_back(0);
+	MPI_Gatherv(&isendbuf[0], (int)isendsize, MPI_INT,
+		&irecvbuf[0], rank == 0 ? &irecvcnt[0] : NULL, rank == 0 ? &irecvdsp[0] : NULL, MPI_INT, 0, MCW);
+	MPI_Gatherv(&fsendbuf[0], (int)fsendsize, MPI_FLOAT,
+		&frecvbuf[0], rank == 0 ? &frecvcnt[0] : NULL, rank == 0 ? &frecvdsp[0] : NULL, MPI_FLOAT, 0, MCW);
+
+	if (rank != 0) return;
+
+	size_t ic = 0, fc = 0;
+	size_t iend = irecvdsp[size - 1] + irecvcnt[size - 1];
+	while (ic < iend) {
+		int ne = irecvbuf[ic + 2], nd = irecvbuf[ic + 3], ns = irecvbuf[ic + 4];
+		Ludata *ludt = new Ludata;
+		ludt->thissubno = irecvbuf[ic];
+		ludt->thisluno = irecvbuf[ic + 1];
+		ludt->totallucells = irecvbuf[ic + 5];
+		ludt->totalsubcells = irecvbuf[ic + 6];
+		ic += nint;
+		ludt->elevarea = frecvbuf[fc];
+		ludt->distarea = frecvbuf[fc + 1];
+		ludt->slparea = frecvbuf[fc + 2];
+		ludt->luareaper = frecvbuf[fc + 3];
+		fc += nfloat;
+		const float *f = &frecvbuf[fc];
+		ludt->elevarr.assign(f, f + ne);              f += ne;
+		ludt->elevperarr.assign(f, f + ne);           f += ne;
+		ludt->distarr.assign(f, f + nd);              f += nd;
+		ludt->distperarr.assign(f, f + nd);           f += nd;
+		ludt->slparr.assign(f, f + ns);               f += ns;
+		ludt->slpperarr.assign(f, f + ns);
+		fc += 2 * (ne + nd + ns);
+		curves.push_back(ludt);
+	}
+
+	// Each subarea comes complete from its owner, in land use order,
+	// so a stable sort on the subarea keeps the land use order.
+	stable_sort(curves.begin(), curves.end(),
+		[](const Ludata *a, const Ludata *b) { return a->thissubno < b->thissubno; });
+}
+
+
+// The cell size used for the area output is the one of the last
+// row holding watershed cells.  Find that row over all processes and
+// share its dxc and dyc.
+void shareLastRowCellSize(int lastGlobalRow, double &dxc, double &dyc)
+{
+	int size;
+	MPI_Comm_size(MCW, &size);
+	if (size <= 1) return;
+
+	int rank;
+	MPI_Comm_rank(MCW, &rank);
+	int rowRank[2], maxRowRank[2];
+	rowRank[0] = lastGlobalRow;
+	rowRank[1] = rank;
+	MPI_Allreduce(rowRank, maxRowRank, 1, MPI_2INT, MPI_MAXLOC, MCW);
+	double cellSize[2] = { dxc, dyc };
+	MPI_Bcast(cellSize, 2, MPI_DOUBLE, maxRowRank[1], MCW);
+	dxc = cellSize[0];
+	dyc = cellSize[1];
+}
+
+#endif
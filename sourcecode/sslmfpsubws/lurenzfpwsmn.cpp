@@ -48,13 +48,19 @@ int lorenzSub(char *pfile,
 	char *lufile,
 	char *elevfile,
 	char *slpfile,
-	char *lzpvajs);
+	char *lzpvajs,
+	char *lzbinfile,
+	bool jscompat);
 
 int main(int argc, char **argv)
 {
 	char pfile[MAXLN], distfile[MAXLN], wsfile[MAXLN], lufile[MAXLN], elevfile[MAXLN], slpfile[MAXLN];
 	char lzpvajs[MAXLN]; // , lzareafile[MAXLN];
 	int err, nmain, i;
+	char lzbinfile[MAXLN];
+	bool jscompat = false;
+	lzpvajs[0] = '\0';
+	lzbinfile[0] = '\0';
 
 	if (argc < 2)
 	{
@@ -148,6 +154,29 @@ int main(int argc, char **argv)
 			else goto errexit;
 		}
 
+		else if (strcmp(argv[i], "-lzbinw") == 0)
+		{
+			i++;
+			if (argc > i)
+			{
+				strcpy(lzbinfile, argv[i]);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if (strcmp(argv[i], "-jscompat") == 0)
+		{
+			jscompat = true;
+			i++;
+		}
+		else if (strcmp(argv[i], "-part") == 0)
+		{
+			i++;
+			if (argc > i && parsePartitionType(argv[i], partitionType))
+				i++;
+			else goto errexit;
+		}
+
 		/*else if (strcmp(argv[i], "-lzaw") == 0)
 		{
 			i++;
@@ -159,6 +188,11 @@ int main(int argc, char **argv)
 			else goto errexit;
 		}*/
 
+		else if(strcmp(argv[i],"-roi")==0)
+		{
+			useRoiWindow = true;
+			i++;
+		}
 		else
 		{
 			goto errexit;
@@ -177,17 +211,18 @@ int main(int argc, char **argv)
 		//nameadd(lzareafile, argv[1], "lzareasws.txt");
 	}
 
-	if (err = lorenzSub(pfile, distfile, wsfile, lufile, elevfile, slpfile, lzpvajs) != 0)
+	if ((err = lorenzSub(pfile, distfile, wsfile, lufile, elevfile, slpfile, lzpvajs, lzbinfile, jscompat)) != 0)
 		printf("Lorenz curve for watershed error %d\n", err);
 
 
-	return 0;
+	return err;
 
 errexit:
 	printf("Simple Usage:\n %s <basefilename>\n", argv[0]);
 	printf("Usage with specific file names:\n %s -p <pfile>\n", argv[0]);
 	printf("-dist <distfile> -ws <wsfile>  -lu <lufile>\n");
-	printf(" -elev <elevfile>  -slp <slpfile> \n");
+	printf(" -elev <elevfile>  -slp <slpfile> [-lzbinw <lzbinfile>] [-jscompat]\n");
+	printf(" [-part linear|block|balanced] [-roi]\n");
 	printf("<basefilename> is the name of the base digital elevation model\n");
 	printf("<pfile> is the d8 flow direction input file.\n");
 	printf("<distfile> is the distance to watershed outlet raster input file.\n");
@@ -196,7 +231,14 @@ errexit:
 	printf("<elevfile> is the elevation raster input file.\n");
 	printf("<slpfile> is the sd8 slope raster input file.\n");
 	printf("<lzpvajs> is the lorenz point area json output file.\n");
+	printf("<lzbinfile> is the optional lorenz binary output file, see lzbin2json.\n");
 	//printf("<lzareafile> is the lorenz area text output file.\n");
+	printf("-jscompat writes the json in the previous layout, indented with\n");
+	printf("values as strings. By default values are written as numbers.\n");
+	printf("-part selects how the grids are divided between processes, in\n");
+	printf("stripes of rows (linear, the default), in blocks, or in stripes\n");
+	printf("with about the same number of valid flow direction cells (balanced).\n");
+	printf("-roi reads and processes only the bounding window of the watershed cells.\n");
 	printf("The following are appended to the file names\n");
 	printf("before the files are opened:\n");
 	printf("p      D8 flow directions (input)\n");
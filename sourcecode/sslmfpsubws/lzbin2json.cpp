@@ -0,0 +1,96 @@
+/*  lzbin2json
+
+  Converts the binary Lorenz curve file written by lorenzfpsub or
+  lorenzfpws (-lzbins / -lzbinw) to the json output of the same tool.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng, RCEES
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email:  qyfeng18@rcees.ac.cn
+*/
+
+#include <stdio.h>
+#include <vector>
+
+#include "lorenzfp.h"
+#include "lorenzjson.h"
+#include "lorenzbin.h"
+
+using namespace std;
+
+
+int lzBin2Json(char *lzbinfile, char *lzjsfile, bool jscompat)
+{
+	LorenzBinReader lzbin;
+	if (!lzbin.open(lzbinfile)) {
+		printf("Could not read lorenz binary file %s\n", lzbinfile);
+		fflush(stdout);
+		return 1;
+	}
+
+	bool isWs = lzbin.fileKind() == LZBINWSFILE;
+	LorenzJsonFile lzjs(lzjsfile, isWs ? "Dist2WSOlt" : "Dist2SubOlt", jscompat);
+	if (!lzjs.isOpen()) {
+		printf("Could not open output file %s\n", lzjsfile);
+		fflush(stdout);
+		return 2;
+	}
+
+	// Convert one subarea at a time
+	vector <Ludata*> subCurves;
+	int i = 0;
+	while (i < lzbin.nCurves()) {
+		int subno = lzbin.entry(i).subno;
+		for (; i < lzbin.nCurves() && lzbin.entry(i).subno == subno; i++) {
+			Ludata *ludt = new Ludata;
+			if (!lzbin.readCurve(i, ludt)) {
+				printf("Error reading curve %d from %s\n", i, lzbinfile);
+				fflush(stdout);
+				delete ludt;
+				for (auto &done : subCurves)
+					delete done;
+				return 3;
+			}
+			subCurves.push_back(ludt);
+		}
+		if (isWs)
+			lzjs.writeWs(subCurves, lzbin.dxc(), lzbin.dyc());
+		else
+			lzjs.writeSub(subCurves, lzbin.dxc(), lzbin.dyc());
+		for (auto &ludt : subCurves)
+			delete ludt;
+		subCurves.clear();
+	}
+	if (!lzjs.close()) {
+		printf("Error writing output file %s\n", lzjsfile);
+		fflush(stdout);
+		return 4;
+	}
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*  lzbin2json
+
+  Converts the binary Lorenz curve file written by lorenzfpsub or
+  lorenzfpws (-lzbins / -lzbinw) to the json output of the same tool.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng, RCEES
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email:  qyfeng18@rcees.ac.cn
+*/
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "commonLib.h"
+
+int lzBin2Json(char *lzbinfile, char *lzjsfile, bool jscompat);
+
+int main(int argc, char **argv)
+{
+	char lzbinfile[MAXLN], lzjsfile[MAXLN];
+	int err, i;
+	bool jscompat = false;
+	lzbinfile[0] = '\0';
+	lzjsfile[0] = '\0';
+
+	if (argc < 3)
+	{
+		goto errexit;
+	}
+
+	i = 1;
+	while (argc > i)
+	{
+		if (strcmp(argv[i], "-lzbin") == 0)
+		{
+			i++;
+			if (argc > i)
+			{
+				strcpy(lzbinfile, argv[i]);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if (strcmp(argv[i], "-lzjs") == 0)
+		{
+			i++;
+			if (argc > i)
+			{
+				strcpy(lzjsfile, argv[i]);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if (strcmp(argv[i], "-jscompat") == 0)
+		{
+			jscompat = true;
+			i++;
+		}
+		else
+		{
+			goto errexit;
+		}
+	}
+
+	if (strlen(lzbinfile) == 0 || strlen(lzjsfile) == 0)
+		goto errexit;
+
+	if ((err = lzBin2Json(lzbinfile, lzjsfile, jscompat)) != 0)
+		printf("Lorenz binary to json error %d\n", err);
+
+	return err;
+
+errexit:
+	printf("Usage:\n %s -lzbin <lzbinfile> -lzjs <lzjsfile> [-jscompat]\n", argv[0]);
+	printf("<lzbinfile> is the lorenz binary file written by lorenzfpsub or lorenzfpws.\n");
+	printf("<lzjsfile> is the json output file.\n");
+	printf("-jscompat writes the json in the previous layout, indented with\n");
+	printf("values as strings. By default values are written as numbers.\n");
+	exit(0);
+}
@@ -61,10 +61,13 @@ class tdpartition{
 		virtual bool isNodata(long x, long y) = 0;
 	    
 		virtual void share() = 0;
+		virtual void shareStart() = 0;
+		virtual void shareWait() = 0;
 		virtual void passBorders() = 0;
 		virtual void addBorders() = 0;
 		virtual void clearBorders() = 0;
 		virtual int ringTerm(int isFinished) = 0;
+		virtual int ringTerm(int isFinished, long &borderUpdates) = 0;
 
 		virtual bool globalToLocal(int globalX, int globalY, int &localX, int &localY) = 0;
 		virtual void localToGlobal(int localX, int localY, int &globalX, int &globalY) = 0;
@@ -91,11 +94,16 @@ class tdpartition{
 		virtual void setToNodata(long x, long y) = 0;
 
 		//virtual void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, double nd) {}  // noDatarefactor 11/18/17
+		virtual void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, int8_t nd){}
 		virtual void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, short nd){}
 		virtual void init(long totalx, long totaly, double dx_in, double dy_in ,MPI_Datatype MPIt, int32_t nd){}
 		virtual void init(long totalx, long totaly, double dx_in, double dy_in, MPI_Datatype MPIt, float nd){}
 		
 
+		virtual int8_t getData(long, long, int8_t&){
+			printf("Attempt to access byte grid with incorrect data type\n");
+			MPI_Abort(MCW,40);return 0;
+		}
 		// noDatarefactor 11/18/17 changed below to int16_t
 		virtual int16_t getData(long, long, int16_t&){
 			printf("Attempt to access short grid with incorrect data type\n");
@@ -113,11 +121,13 @@ class tdpartition{
 
 		virtual void savedxdyc(tiffIO &obj ){}
 		virtual void getdxdyc(long, double&, double&){}
+		virtual void setData(long, long, int8_t){}
 		// noDatarefactor 11/18/17 changed below to int16_t
 	    virtual void setData(long, long, int16_t){}
 		virtual void setData(long, long, int32_t){}
 		virtual void setData(long, long, float){}
 
+		virtual void addToData(long, long, int8_t){}
 		// noDatarefactor 11/18/17 changed below to int16_t
 		virtual void addToData(long, long, int16_t){}
 		virtual void addToData(long, long, int32_t){}
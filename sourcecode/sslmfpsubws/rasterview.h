@@ -0,0 +1,289 @@
+/*  rasterview header
+
+  Direct, non virtual access to the cells of a linearpart.
+
+  RasterView gives the interior rows of a partition together with
+  the border rows received by share(), and for a blockpart also the
+  left and right border columns and the corner cells, so the loops
+  over the whole partition can read and write the cells without
+  going through the virtual getData/isNodata/setData of tdpartition.
+  RowBitmap marks the cells that are not nodata, one bit per cell,
+  so the loops can skip the nodata cells and the empty rows.
+  CellQueue is the queue of cells of the flow path traversals.
+
+  A view only holds pointers into the partition. It stays valid as
+  long as the partition exists, share() and addBorders() write into
+  the same buffers.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email: qyfeng18@rcees.ac.cn
+*/
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <queue>
+#include "commonLib.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+#ifndef RASTERVIEW_H
+#define RASTERVIEW_H
+
+// Same test as linearpart::isNodata, exact for the integer types
+template <class datatype>
+inline bool isNodataValue(datatype val, datatype noData) {
+	return val == noData;
+}
+
+template <>
+inline bool isNodataValue<float>(float val, float noData) {
+	return fabs(val - noData) < MINEPS;
+}
+
+template <class datatype>
+class RasterView {
+public:
+	datatype *data;         // interior rows, row y starts at data + y*nx
+	datatype *topBorder;    // row -1, from the process above
+	datatype *bottomBorder; // row ny, from the process below
+	datatype *leftBorder;   // column -1, NULL for a linearpart
+	datatype *rightBorder;  // column nx, NULL for a linearpart
+	datatype *corners;      // (-1,-1), (nx,-1), (-1,ny), (nx,ny), NULL for a linearpart
+	long nx, ny;
+	datatype noData;
+	bool hasTop, hasBottom; // false where there is no neighboring process
+	bool hasLeft, hasRight;
+
+	RasterView() {
+		data = topBorder = bottomBorder = leftBorder = rightBorder = corners = NULL;
+		nx = ny = 0;
+		hasTop = hasBottom = hasLeft = hasRight = false;
+	}
+
+	// Cell of the partition or of its borders, NULL outside
+	datatype *cell(long x, long y) const {
+		if (y >= 0 && y < ny) {
+			if (x >= 0 && x < nx) return data + y * nx + x;
+			if (leftBorder == NULL) return NULL;
+			if (x == -1) return leftBorder + y;
+			if (x == nx) return rightBorder + y;
+			return NULL;
+		}
+		int k;
+		if (y == -1) k = 0;
+		else if (y == ny) k = 2;
+		else return NULL;
+		if (x >= 0 && x < nx) return (k == 0 ? topBorder : bottomBorder) + x;
+		if (corners == NULL) return NULL;
+		if (x == -1) return corners + k;
+		if (x == nx) return corners + k + 1;
+		return NULL;
+	}
+
+	datatype *row(long y) const { return data + y * nx; }
+
+	bool isInPartition(long x, long y) const {
+		return x >= 0 && x < nx && y >= 0 && y < ny;
+	}
+
+	// Same as hasAccess of the partition
+	bool hasAccess(long x, long y) const {
+		bool inx = x >= 0 && x < nx;
+		bool iny = y >= 0 && y < ny;
+		if (inx && iny) return true;
+		return (inx || (x == -1 && hasLeft) || (x == nx && hasRight))
+			&& (iny || (y == -1 && hasTop) || (y == ny && hasBottom));
+	}
+
+	// Cell of the partition or of the borders, nodata outside
+	datatype get(long x, long y) const {
+		if (x >= 0 && x < nx && y >= 0 && y < ny) return data[y * nx + x];
+		datatype *p = cell(x, y);
+		return p != NULL ? *p : noData;
+	}
+
+	bool isNodata(long x, long y) const {
+		return isNodataValue(get(x, y), noData);
+	}
+
+	void set(long x, long y, datatype val) {
+		datatype *p = cell(x, y);
+		if (p != NULL) *p = val;
+	}
+
+	void add(long x, long y, datatype val) {
+		datatype *p = cell(x, y);
+		if (p != NULL) *p += val;
+	}
+};
+
+
+/*
+** RowBitmap
+**
+** One bit per cell of the partition, set where the cell is not
+** nodata, with the number of such cells of each row. Loop over the
+** valid cells of row j with
+**     for (i = mask.first(j); i < nx; i = mask.next(j, i))
+*/
+class RowBitmap {
+private:
+	long nx, ny, nwords;
+	vector <uint64_t> bits;
+	vector <long> rowcount;
+
+	static int lowestBit(uint64_t w) {
+#if defined(_MSC_VER)
+		unsigned long idx;
+		_BitScanForward64(&idx, w);
+		return (int)idx;
+#else
+		return __builtin_ctzll(w);
+#endif
+	}
+
+	static int countBits(uint64_t w) {
+#if defined(_MSC_VER)
+		return (int)__popcnt64(w);
+#else
+		return __builtin_popcountll(w);
+#endif
+	}
+
+	// First set bit of row y at or after column x, nx if none
+	long scan(long y, long x) const {
+		if (x >= nx) return nx;
+		const uint64_t *rowbits = &bits[y * nwords];
+		long wi = x >> 6;
+		uint64_t w = rowbits[wi] & (~(uint64_t)0 << (x & 63));
+		while (w == 0) {
+			if (++wi >= nwords) return nx;
+			w = rowbits[wi];
+		}
+		return (wi << 6) + lowestBit(w);
+	}
+
+public:
+	RowBitmap() {
+		nx = ny = nwords = 0;
+	}
+
+	template <class datatype>
+	void build(const RasterView<datatype> &view) {
+		nx = view.nx;
+		ny = view.ny;
+		nwords = (nx + 63) / 64;
+		bits.assign(ny * nwords, 0);
+		rowcount.assign(ny, 0);
+		for (long y = 0; y < ny; y++) {
+			const datatype *vals = view.row(y);
+			uint64_t *rowbits = &bits[y * nwords];
+			long count = 0;
+			for (long wi = 0; wi < nwords; wi++) {
+				long x0 = wi << 6;
+				long n = nx - x0 < 64 ? nx - x0 : 64;
+				uint64_t w = 0;
+				for (long b = 0; b < n; b++)
+					w |= (uint64_t)(!isNodataValue(vals[x0 + b], view.noData)) << b;
+				rowbits[wi] = w;
+				count += countBits(w);
+			}
+			rowcount[y] = count;
+		}
+	}
+
+	bool isValid(long x, long y) const {
+		return (bits[y * nwords + (x >> 6)] >> (x & 63)) & 1;
+	}
+
+	long rowCount(long y) const { return rowcount[y]; }
+
+	long first(long y) const { return rowcount[y] ? scan(y, 0) : nx; }
+	long next(long y, long x) const { return scan(y, x + 1); }
+};
+
+/*
+** CellQueue
+**
+** First in first out queue of the cells of a partition, kept as 32 bit
+** linear indices y*nx+x in a ring buffer (see the assumptions in tiffIO.h,
+** a partition has less than 4G cells).  The buffer doubles when it is
+** full and is kept for the next pass.  Only the cells of the partition
+** are queued, not those of the borders.
+*/
+class CellQueue {
+private:
+	vector <uint32_t> buf;
+	size_t head, count, mask;
+	long nx;
+
+	void grow() {
+		vector <uint32_t> bigger(buf.size() * 2);
+		for (size_t n = 0; n < count; n++)
+			bigger[n] = buf[(head + n) & mask];
+		buf.swap(bigger);
+		head = 0;
+		mask = buf.size() - 1;
+	}
+
+public:
+	CellQueue(long nx_in) {
+		nx = nx_in;
+		buf.resize(1024);
+		head = count = 0;
+		mask = buf.size() - 1;
+	}
+
+	bool empty() const { return count == 0; }
+	size_t size() const { return count; }
+	long width() const { return nx; }
+
+	void push(uint32_t idx) {
+		if (count == buf.size()) grow();
+		buf[(head + count) & mask] = idx;
+		count++;
+	}
+
+	uint32_t pop() {
+		uint32_t idx = buf[head];
+		head = (head + 1) & mask;
+		count--;
+		return idx;
+	}
+
+	// Cell n places after the front, n < size()
+	uint32_t peek(size_t n) const { return buf[(head + n) & mask]; }
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*  sslmfpcore header
+
+  The computations of lorenzfpsub and subindexmap on grids that are
+  already in memory, the distances of dist2subolt and dist2wsolt are
+  computed by distToOutlets in distolt.h.  The tools read their grids
+  from files and call these, sslmfppipe runs them one after the other
+  on the same partitions without writing the grids in between.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email: qyfeng18@rcees.ac.cn
+*/
+
+#ifndef SSLMFPCORE_H
+#define SSLMFPCORE_H
+
+#include "partition.h"
+#include "tiffIO.h"
+
+//  lorenzfpsub.cpp
+int lorenzSubCurves(tdpartition *flowDir,
+	tdpartition *distgrid,
+	tdpartition *ws,
+	tdpartition *lugrid,
+	tdpartition *elevgrid,
+	tdpartition *slpgrid,
+	tiffIO *luf,
+	tiffIO *distf,
+	tiffIO *elevf,
+	tiffIO *slpf,
+	char *lzpvajson,
+	char *lzbinfile,
+	bool jscompat,
+	double &computet);
+
+//  subindexmap.cpp
+tdpartition *subIndexClasses(tdpartition *ws, char *subidxjson);
+
+#endif
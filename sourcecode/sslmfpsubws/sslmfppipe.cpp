@@ -0,0 +1,213 @@
+/*  sslmfppipe
+
+  Runs dist2subolt, lorenzfpsub and subindexmap one after the other in
+  one process group.  The flow direction and subarea grids are read once
+  and kept in memory, and the distance to subarea outlet grid is passed
+  straight to the Lorenz curves without writing it.  The distance grid
+  is only written when a file name is given for it.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into
+other software that does not meet the GNU General Public License
+conditions contact the author to request permission.
+Qingyu Feng
+email: qyfeng18@rcees.ac.cn
+*/
+
+#include <mpi.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "commonLib.h"
+#include "linearpart.h"
+#include "createpart.h"
+#include "tiffIO.h"
+#include "sslmfpcore.h"
+#include "distolt.h"
+
+using namespace std;
+
+// Check that an input grid has the size of the flow direction grid and
+// start reading the rows of this process into a new partition
+static tdpartition *startInput(tiffIO &f, tiffIO &pf, char *fname, tdpartition *flowDir)
+{
+	if (!pf.compareTiff(f)) {
+		printf("File sizes do not match\n%s\n", fname);
+		fflush(stdout);
+		MPI_Abort(MCW, 5);
+	}
+	tdpartition *part = CreateNewPartition(f.getDatatype(), flowDir->gettotalx(), flowDir->gettotaly(),
+		flowDir->getdxA(), flowDir->getdyA(), f.getNodata());
+	int xstart, ystart;
+	flowDir->localToGlobal(0, 0, xstart, ystart);
+	f.readStart(xstart, ystart, flowDir->getny(), flowDir->getnx(), part->getGridPointer());
+	return part;
+}
+
+int sslmfpPipeline(char *pfile,
+	char *srcfile,
+	char *wsfile,
+	char *lufile,
+	char *elevfile,
+	char *slpfile,
+	int thresh,
+	char *distfile,
+	char *wsdistfile,
+	char *lzpvajson,
+	char *lzbinfile,
+	bool jscompat,
+	char *subidxjson,
+	char *subidxmap)
+{
+//The threads of the distance passes make no MPI calls
+int provided, err = 0;
+MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&provided);
+{  //  All code within braces so that objects go out of context and destruct before MPI is closed
+	int rank,size;
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+	if(rank==0)printf("sslmfppipe version %s\n",TDVERSION);
+
+ //  Begin timer
+	double begint = MPI_Wtime();
+
+	//With -roi only the bounding window of the watershed cells is read and processed
+	if(useRoiWindow) setValidWindow(wsfile);
+
+	//Read Flow Direction header using tiffIO
+	tiffIO pf(pfile,BYTE_TYPE);
+	long totalX = pf.getTotalX();
+	long totalY = pf.getTotalY();
+	double dxA = pf.getdxA();
+	double dyA = pf.getdyA();
+
+	//Balanced stripes are chosen from the valid flow direction cells of each row
+	if(partitionType == BALANCED_PART){
+		vector<long> rowCounts(totalY);
+		pf.validCellsPerRow(&rowCounts[0]);
+		setPartitionRows(&rowCounts[0], totalY);
+	}
+
+	//All the grids use the partition of the flow direction grid
+	tdpartition *flowDir;
+	flowDir = CreateNewPartition(pf.getDatatype(), totalX, totalY, dxA, dyA, pf.getNodata());
+	int nx = flowDir->getnx();
+	int ny = flowDir->getny();
+	int xstart, ystart;
+	flowDir->localToGlobal(0, 0, xstart, ystart);
+	flowDir->savedxdyc(pf);
+	pf.readStart(xstart, ystart, ny, nx, flowDir->getGridPointer());
+
+	//The subarea ids are read as long, as lorenzfpsub and subindexmap do
+	tiffIO srcf(srcfile, LONG_TYPE);
+	tdpartition *src = startInput(srcf, pf, srcfile, flowDir);
+	tiffIO wsf(wsfile, LONG_TYPE);
+	tdpartition *ws = startInput(wsf, pf, wsfile, flowDir);
+
+	//The grids of the Lorenz curves are read while the distances are computed
+	tiffIO luf(lufile, LONG_TYPE);
+	tdpartition *lugrid = startInput(luf, pf, lufile, flowDir);
+	tiffIO elevf(elevfile, FLOAT_TYPE);
+	tdpartition *elevgrid = startInput(elevf, pf, elevfile, flowDir);
+	tiffIO slpf(slpfile, FLOAT_TYPE);
+	tdpartition *slpgrid = startInput(slpf, pf, slpfile, flowDir);
+
+	pf.readWait();
+	srcf.readWait();
+	wsf.readWait();
+
+	//Record time reading files
+	double readt = MPI_Wtime();
+
+	//Distance to subarea outlet, and to the watershed outlet in the
+	//same traversal when it is asked for
+	long borderCells[2];
+	tdpartition *fdarr, *wsdarr;
+	if (strlen(wsdistfile) > 0)
+		distToOutlets<BothOltDist>(flowDir, src, ws, thresh, fdarr, wsdarr, borderCells);
+	else
+		distToOutlets<SubOltDist>(flowDir, src, ws, thresh, fdarr, wsdarr, borderCells);
+	delete src;
+	double distt = MPI_Wtime();
+
+	//The distance grids are only written when asked for
+	float aNodata = MISSINGFLOAT;
+	if (strlen(distfile) > 0) {
+		tiffIO a(distfile, FLOAT_TYPE, aNodata, pf);
+		a.write(xstart, ystart, ny, nx, fdarr->getGridPointer());
+	}
+	if (wsdarr != NULL) {
+		tiffIO a(wsdistfile, FLOAT_TYPE, aNodata, pf);
+		a.write(xstart, ystart, ny, nx, wsdarr->getGridPointer());
+		delete wsdarr;
+	}
+	double distwritet = MPI_Wtime();
+
+	//Lorenz curves of the subareas, from the distances in memory
+	double lorenzct;
+	err = lorenzSubCurves(flowDir, fdarr, ws, lugrid, elevgrid, slpgrid,
+		&luf, NULL, &elevf, &slpf, lzpvajson, lzbinfile, jscompat, lorenzct);
+	delete fdarr;
+	delete lugrid;
+	delete elevgrid;
+	delete slpgrid;
+	double lorenzt = MPI_Wtime();
+
+	//Map of the sslm index of the subareas, when its index file is given
+	double indext = lorenzt, indexwritet = lorenzt;
+	if (strlen(subidxjson) > 0 && strlen(subidxmap) > 0) {
+		tdpartition *subindex = subIndexClasses(ws, subidxjson);
+		indext = MPI_Wtime();
+		int16_t sNodata = MISSINGSHORT;
+		tiffIO a(subidxmap, SHORT_TYPE, sNodata, wsf);
+		a.write(xstart, ystart, ny, nx, subindex->getGridPointer());
+		delete subindex;
+		indexwritet = MPI_Wtime();
+	}
+
+	double times[6], tempd[6];
+	times[0] = readt - begint;
+	times[1] = distt - readt;
+	times[2] = lorenzct - distwritet;
+	times[3] = indext - lorenzt;
+	times[4] = (distwritet - distt) + (lorenzt - lorenzct) + (indexwritet - indext);
+	times[5] = indexwritet - begint;
+	MPI_Allreduce(times, tempd, 6, MPI_DOUBLE, MPI_SUM, MCW);
+
+	if( rank == 0)
+		printf("Processors: %d\nRead time: %f\nDistance time: %f\nLorenz time: %f\nIndex map time: %f\nWrite time: %f\nTotal time: %f\n",
+			size, tempd[0]/size, tempd[1]/size, tempd[2]/size, tempd[3]/size, tempd[4]/size, tempd[5]/size);
+	if( rank == 0 && size > 1)
+		printf("Border cells solved: %ld and %ld\n",
+			borderCells[0], borderCells[1]);
+
+	delete ws;
+	delete flowDir;
+
+	//Brackets force MPI-dependent objects to go out of scope before Finalize is called
+	}MPI_Finalize();
+return(err);
+}
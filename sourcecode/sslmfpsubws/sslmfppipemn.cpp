@@ -0,0 +1,257 @@
+/*  sslmfppipemn
+
+  The main program to run the distance to subarea outlet, the Lorenz
+  curves of the subareas and the subarea sslm index map in one run.
+
+  Qingyu Feng
+  RCEES
+  October 16, 2026
+
+*/
+
+/*  Copyright (C) 2020  Qingyu Feng, RCEES
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License 
+version 2, 1991 as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+A copy of the full GNU General Public License is included in file 
+gpl.html. This is also available at:
+http://www.gnu.org/copyleft/gpl.html
+or from:
+The Free Software Foundation, Inc., 59 Temple Place - Suite 330, 
+Boston, MA  02111-1307, USA.
+
+If you wish to use or incorporate this program (or parts of it) into 
+other software that does not meet the GNU General Public License 
+conditions contact the author to request permission.
+Qingyu Feng
+email:  qyfeng18@rcees.ac.cn
+*/
+
+  
+#include <time.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "commonLib.h"
+
+int sslmfpPipeline(char *pfile,
+	char *srcfile,
+	char *wsfile,
+	char *lufile,
+	char *elevfile,
+	char *slpfile,
+	int thresh,
+	char *distfile,
+	char *wsdistfile,
+	char *lzpvajson,
+	char *lzbinfile,
+	bool jscompat,
+	char *subidxjson,
+	char *subidxmap);
+
+//  Copy the file name following option argv[i]
+static bool fileArg(int argc, char **argv, int &i, char *fname)
+{
+	i++;
+	if (argc <= i) return false;
+	strcpy(fname, argv[i]);
+	i++;
+	return true;
+}
+
+int main(int argc,char **argv)
+{
+   char pfile[MAXLN], srcfile[MAXLN], wsfile[MAXLN], lufile[MAXLN], elevfile[MAXLN], slpfile[MAXLN];
+   char distfile[MAXLN], wsdistfile[MAXLN], lzpvajson[MAXLN], lzbinfile[MAXLN], subidxjson[MAXLN], subidxmap[MAXLN];
+   int err, thresh=1, i;
+   bool jscompat = false;
+   distfile[0] = '\0';
+   wsdistfile[0] = '\0';
+   lzpvajson[0] = '\0';
+   lzbinfile[0] = '\0';
+   subidxjson[0] = '\0';
+   subidxmap[0] = '\0';
+   
+   if(argc < 2)
+    {  
+       printf("Error: To run this program, use either the Simple Usage option or\n");
+	   printf("the Usage with Specific file names option\n");
+	   goto errexit;
+    }
+   
+   else if(argc > 2)
+	{
+		i = 1;
+	}
+	else {
+		i = 2;
+	}
+
+	while(argc > i)
+	{
+		if(strcmp(argv[i],"-p")==0)
+		{
+			if(!fileArg(argc, argv, i, pfile)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-src")==0)
+		{
+			if(!fileArg(argc, argv, i, srcfile)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-ws")==0)
+		{
+			if(!fileArg(argc, argv, i, wsfile)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-lu")==0)
+		{
+			if(!fileArg(argc, argv, i, lufile)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-elev")==0)
+		{
+			if(!fileArg(argc, argv, i, elevfile)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-slp")==0)
+		{
+			if(!fileArg(argc, argv, i, slpfile)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-d2so")==0)
+		{
+			if(!fileArg(argc, argv, i, distfile)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-d2wo")==0)
+		{
+			if(!fileArg(argc, argv, i, wsdistfile)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-lzjss")==0)
+		{
+			if(!fileArg(argc, argv, i, lzpvajson)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-lzbins")==0)
+		{
+			if(!fileArg(argc, argv, i, lzbinfile)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-ijs")==0)
+		{
+			if(!fileArg(argc, argv, i, subidxjson)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-ims")==0)
+		{
+			if(!fileArg(argc, argv, i, subidxmap)) goto errexit;
+		}
+		else if(strcmp(argv[i],"-thresh")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				sscanf(argv[i],"%d",&thresh);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-jscompat")==0)
+		{
+			jscompat = true;
+			i++;
+		}
+		else if(strcmp(argv[i],"-part")==0)
+		{
+			i++;
+			if(argc > i && parsePartitionType(argv[i], partitionType))
+				i++;
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-threads")==0)
+		{
+			i++;
+			if(argc > i)
+			{
+				sscanf(argv[i],"%d",&numThreads);
+				i++;
+			}
+			else goto errexit;
+		}
+		else if(strcmp(argv[i],"-roi")==0)
+		{
+			useRoiWindow = true;
+			i++;
+		}
+		else if(isOutputOption(argv[i]))
+		{
+			if(!parseOutputOption(argc, argv, i)) goto errexit;
+		}
+		else 
+		{
+			goto errexit;
+		}
+	}   
+
+	if(argc == 2)
+	{
+		nameadd(pfile,argv[1],"p");
+		nameadd(srcfile,argv[1],"src");
+		nameadd(wsfile, argv[1], "ws");
+		nameadd(lufile,argv[1],"lu");
+		nameadd(elevfile, argv[1], "elev");
+		nameadd(slpfile, argv[1], "slp");
+		nameadd(lzpvajson, argv[1], "lzpva.json");
+	}
+
+    if((err=sslmfpPipeline(pfile, srcfile, wsfile, lufile, elevfile, slpfile, thresh, distfile, wsdistfile,
+		lzpvajson, lzbinfile, jscompat, subidxjson, subidxmap)) != 0)
+        printf("sslmfp pipeline error %d\n",err);
+
+
+	return err;
+
+	errexit:
+	   printf("Simple Usage:\n %s <basefilename>\n",argv[0]);
+       printf("Usage with specific file names:\n %s -p <pfile>\n",argv[0]);
+	   printf("-src <srcfile> -ws <wsfile> -lu <lufile> -elev <elevfile> -slp <slpfile>\n");
+	   printf(" -lzjss <lzpvajson> [-lzbins <lzbinfile>] [-jscompat] [-thresh <thresh>]\n");
+	   printf(" [-d2so <distfile>] [-d2wo <wsdistfile>] [-ijs <subidxjson> -ims <subidxmap>]\n");
+	   printf(" [-part linear|block|balanced] [-roi]\n");
+	   printf(" [-threads <n>]\n");
+  	   printf("<basefilename> is the name of the base sslmfp model\n");
+	   printf("<pfile> is the d8 flow direction input file.\n");
+       printf("<srcfile> is the stream raster input file.\n");
+	   printf("<wsfile> is the watershed boundary raster input file.\n");
+       printf("<lufile> is the land use raster input file.\n");
+	   printf("<elevfile> is the elevation raster input file.\n");
+	   printf("<slpfile> is the sd8 slope raster input file.\n");
+	   printf("<lzpvajson> is the lorenz point area json output file.\n");
+	   printf("<lzbinfile> is the optional lorenz binary output file, see lzbin2json.\n");
+	   printf("The optional <thresh> is the user input threshold number.\n");
+	   printf("<distfile> is the optional distance to subarea outlet output file.\n");
+	   printf("The distances are passed to the Lorenz curves in memory, they\n");
+	   printf("are only written when this file is given.\n");
+	   printf("<wsdistfile> is the optional distance to watershed outlet output\n");
+	   printf("file, computed in the same pass as the distance to subarea outlet.\n");
+	   printf("<subidxjson> is the sslm index json input file and <subidxmap> the\n");
+	   printf("sslm index map output file, the map is made when both are given.\n");
+	   printf("-jscompat writes the json in the previous layout, indented with\n");
+	   printf("values as strings. By default values are written as numbers.\n");
+	   printf("-part selects how the grids are divided between processes, in\n");
+	   printf("stripes of rows (linear, the default), in blocks, or in stripes\n");
+	   printf("with about the same number of valid flow direction cells (balanced).\n");
+	   printOutputOptionsUsage();
+	   printf("-threads sets the number of threads of each process that evaluate\n");
+	   printf("the cells in the distance passes, 0 for one per core, default 1.\n");
+	   printf("-roi reads and processes only the bounding window of the watershed\n");
+	   printf("cells, the outputs are written at their place in the whole grid.\n");
+       printf("The following are appended to the file names\n");
+       printf("before the files are opened:\n");
+       printf("p      D8 flow directions (input)\n");
+       printf("src    stream raster file (Input)\n");
+	   printf("ws     watershed boundary raster file (Input)\n");
+       printf("lu     landuse raster file (input)\n");
+	   printf("elev   elevation raster file (input)\n");
+	   printf("slp    slope raster file (input)\n");
+	   printf("lzpva.json   lorenz for subarea json file (output)\n");
+       exit(0);
+} 
@@ -58,13 +58,14 @@ email:  qyfeng18@rcees.ac.cn
 #include <stdlib.h>
 
 #include "idxhash.h"
+#include "sslmfpcore.h"
 
 using namespace std;
 using namespace rapidjson;
 
 
 
-bool compare_float(float x, float y, float epsilon = 0.001f) {
+static bool compare_float(float x, float y, float epsilon = 0.001f) {
 	if (fabs(x - y) < epsilon)
 		return true; //they are same
 	return false; //they are not same
@@ -75,7 +76,7 @@ bool compare_float(float x, float y, float epsilon = 0.001f) {
 // mapserver has no datavalue as 0, so, we can not use it.
 // Besides, it require 8 bit map, which will be converted later
 // using gdal
-int ssidxValue2Class(float sslmval) {
+static int ssidxValue2Class(float sslmval) {
 	
 	int recalval = 0;
 	if (sslmval <= 0.1) { recalval = 1; }
@@ -95,66 +96,40 @@ int ssidxValue2Class(float sslmval) {
 
 
 
-int subindexmap(char *wsfile,
-	char *subidxjson,
-	char *subidxmap
-)
+// Map of the classes of the sslm index of each subarea, from the
+// subarea ws grid in memory (a long grid) and the index values in
+// subidxjson.  The classes are returned in a new short partition.
+tdpartition *subIndexClasses(tdpartition *ws, char *subidxjson)
 {
-
-MPI_Init(NULL,NULL);{  
-	//  All code within braces so that objects go out of context and destruct before MPI is closed
-	int rank,size;
-	MPI_Comm_rank(MCW,&rank);
-	MPI_Comm_size(MCW,&size);
-	if(rank==0)printf("sslmfpsub version %s\n",TDVERSION);
-	int i,j,in,jn;
-	float tempFloat; 
-	double tempdxc,tempdyc;
-	short tempShort,k;
-	int32_t tempLong;
-	bool finished;
-
- //  Begin timer
-    double begint = MPI_Wtime();
-
-	//Read Flow Direction header using tiffIO
-	tiffIO wsf(wsfile, LONG_TYPE);
-	long totalX = wsf.getTotalX();
-	long totalY = wsf.getTotalY();
-	double dxA = wsf.getdxA();
-	double dyA = wsf.getdyA();
-
-	if(rank==0)
-		{
-			float timeestimate=(1.2e-6*totalX*totalY/pow((double) size,0.65))/60+1;  // Time estimate in minutes
-			fprintf(stderr,"This run may take on the order of %.0f minutes to complete.\n",timeestimate);
-			fprintf(stderr,"This estimate is very approximate. \nRun time is highly uncertain as it depends on the complexity of the input data \nand speed and memory of the computer. This estimate is based on our testing on \na dual quad core Dell Xeon E5405 2.0GHz PC with 16GB RAM.\n");
-			fflush(stderr);
-		}
-
-	//Read flow direction data into partition
-	tdpartition *ws;
-	ws = CreateNewPartition(wsf.getDatatype(), totalX, totalY, dxA, dyA, wsf.getNodata());
+	int i,j;
+	long totalX = ws->gettotalx();
+	long totalY = ws->gettotaly();
+	double dxA = ws->getdxA();
+	double dyA = ws->getdyA();
 	int nx = ws->getnx();
 	int ny = ws->getny();
-	int xstart, ystart;
-	ws->localToGlobal(0, 0, xstart, ystart);
-	ws->savedxdyc(wsf);
-	wsf.read(xstart, ystart, ny, nx, ws->getGridPointer());
+
+	// Direct access to the subarea grid, with its cells that are
+	// not nodata marked
+	RasterView<int32_t> wsv = partitionView<int32_t>(ws);
+	RowBitmap wsMask;
+	wsMask.build(wsv);
 
 	// Get a vector of subIDs
 	vector <long> subids;
 	int subno;
+	int lastsubno = 0;
 	for (j = 0; j < ny; ++j) {
-		for (i = 0; i < nx; ++i) {
-			if (!ws->isNodata(i, j))
+		const int32_t *wsrow = wsv.row(j);
+		for (i = wsMask.first(j); i < nx; i = wsMask.next(j, i)) {
+			subno = wsrow[i];
+			// Neighbouring cells are mostly in the same subarea
+			if (!subids.empty() && subno == lastsubno)
+				continue;
+			lastsubno = subno;
+			if (find(subids.begin(), subids.end(), subno) == subids.end())
 			{
-				subno = ws->getData(i, j, tempLong);
-				if (find(subids.begin(), subids.end(), subno) == subids.end())
-				{
-					subids.push_back(subno);
-				}
-
+				subids.push_back(subno);
 			}
 		}
 	}
@@ -175,17 +150,15 @@ MPI_Init(NULL,NULL);{
 	fclose(fp);
 
 
-
-	//Record time reading files
-	double readt = MPI_Wtime();
-
 	// Put subid into a hash table
 	float hsSearchRlt;
 	Value subIdxValObj;
 	float subIdxVal;
 	subno = 0;
-	// Need the total number to determine the size of hashtable
-	totalsubnos = subids.size();
+	// Need the total number to determine the size of hashtable.
+	// The json may list subareas that are not in the rows of this
+	// process, the table needs room for all of them.
+	totalsubnos = subids.size() + indexSubJson.MemberCount();
 	HashMapTable subIndexs;
 
 
@@ -216,13 +189,24 @@ MPI_Init(NULL,NULL);{
 	tdpartition *subindex;
 	subindex = CreateNewPartition(SHORT_TYPE, totalX, totalY, dxA, dyA, MISSINGSHORT);
 
+	RasterView<int16_t> subindexv = partitionView<int16_t>(subindex);
+
 	int subIdxValint;
+	// Class of the previous cell, looked up again only when the
+	// subarea changes
+	short subIdxClass = MISSINGSHORT;
+	bool hasLast = false;
 
 	for (j = 0; j < ny; ++j) {
-		for (i = 0; i < nx; ++i) {
-			if (!ws->isNodata(i, j))
+		const int32_t *wsrow = wsv.row(j);
+		int16_t *subidxrow = subindexv.row(j);
+		for (i = wsMask.first(j); i < nx; i = wsMask.next(j, i)) {
+			subno = wsrow[i];
+			if (!hasLast || subno != lastsubno)
 			{
-				subno = ws->getData(i, j, tempLong);
+				hasLast = true;
+				lastsubno = subno;
+				subIdxClass = MISSINGSHORT;
 				hsSearchRlt = subIndexs.SearchKey(subno);
 				// If it has the value insert one.
 				if (not compare_float(hsSearchRlt, -1.0))
@@ -235,14 +219,70 @@ MPI_Init(NULL,NULL);{
 					subIdxVal = subIndexs.getValue(subno);
 					//subIdxValint = (int)floor(subIdxVal * 100.0 + 0.5);
 					//printf("IndexValue: %d\n", subIdxValint);
-					subindex->setData(i, j, (short)ssidxValue2Class(subIdxVal));
+					subIdxClass = (short)ssidxValue2Class(subIdxVal);
 				}
 			}
+			if (subIdxClass != MISSINGSHORT)
+				subidxrow[i] = subIdxClass;
 		}
 	}
 
 	subindex->share();
 
+	return subindex;
+}
+
+
+int subindexmap(char *wsfile,
+	char *subidxjson,
+	char *subidxmap
+)
+{
+
+MPI_Init(NULL,NULL);{  
+	//  All code within braces so that objects go out of context and destruct before MPI is closed
+	int rank,size;
+	MPI_Comm_rank(MCW,&rank);
+	MPI_Comm_size(MCW,&size);
+	if(rank==0)printf("sslmfpsub version %s\n",TDVERSION);
+
+ //  Begin timer
+    double begint = MPI_Wtime();
+
+	//With -roi only the bounding window of the watershed cells is read and processed
+	if(useRoiWindow) setValidWindow(wsfile);
+
+	//Read Flow Direction header using tiffIO
+	tiffIO wsf(wsfile, LONG_TYPE);
+	long totalX = wsf.getTotalX();
+	long totalY = wsf.getTotalY();
+	double dxA = wsf.getdxA();
+	double dyA = wsf.getdyA();
+
+	if(rank==0)
+		{
+			float timeestimate=(1.2e-6*totalX*totalY/pow((double) size,0.65))/60+1;  // Time estimate in minutes
+			fprintf(stderr,"This run may take on the order of %.0f minutes to complete.\n",timeestimate);
+			fprintf(stderr,"This estimate is very approximate. \nRun time is highly uncertain as it depends on the complexity of the input data \nand speed and memory of the computer. This estimate is based on our testing on \na dual quad core Dell Xeon E5405 2.0GHz PC with 16GB RAM.\n");
+			fflush(stderr);
+		}
+
+	//Read flow direction data into partition
+	tdpartition *ws;
+	ws = CreateNewPartition(wsf.getDatatype(), totalX, totalY, dxA, dyA, wsf.getNodata());
+	int nx = ws->getnx();
+	int ny = ws->getny();
+	int xstart, ystart;
+	ws->localToGlobal(0, 0, xstart, ystart);
+	ws->savedxdyc(wsf);
+	wsf.read(xstart, ystart, ny, nx, ws->getGridPointer());
+
+	//Record time reading files
+	double readt = MPI_Wtime();
+
+	//Map the index classes
+	tdpartition *subindex = subIndexClasses(ws, subidxjson);
+
 	//Stop timer
 	double computet = MPI_Wtime();
 
@@ -105,6 +105,15 @@ int main(int argc,char **argv)
 			else goto errexit;
 		}
 
+		else if(strcmp(argv[i],"-roi")==0)
+		{
+			useRoiWindow = true;
+			i++;
+		}
+		else if(isOutputOption(argv[i]))
+		{
+			if(!parseOutputOption(argc, argv, i)) goto errexit;
+		}
 		else 
 		{
 			goto errexit;
@@ -127,11 +136,14 @@ int main(int argc,char **argv)
 	errexit:
 	   printf("Simple Usage:\n %s <basefilename>\n",argv[0]);
        printf("Usage with specific file names:\n %s -ws <wsfile>\n",argv[0]);
-	   printf(" -ijs <subidxjson>  -ijm <subidxmap> \n");
+	   printf(" -ijs <subidxjson>  -ijm <subidxmap> [-roi]\n");
   	   printf("<basefilename> is the name of the base sslmfp model\n");
 	   printf("<wsfile> is the watershed boundary raster input file.\n");
 	   printf("<subidxjson> is the sslm index json input file.\n");
 	   printf("<subidxmap> is the sslmindex map for subarea output file.\n");
+	   printOutputOptionsUsage();
+	   printf("-roi reads and processes only the bounding window of the watershed\n");
+	   printf("cells, the output is written at its place in the whole grid.\n");
        printf("The following are appended to the file names\n");
        printf("before the files are opened:\n");
 	   printf("ws     watershed boundary raster file (Input)\n");
@@ -49,130 +49,254 @@ email:  dtarb@usu.edu
 #include <math.h>
 //#include "commonLib.h"  //Part of tiffIO.h
 #include <iostream>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <functional>
 using namespace std;
 
-tiffIO::tiffIO(char *fname, DATA_TYPE newtype) {
-	MPI_Status status;
-	MPI_Offset mpiOffset;
-
-	MPI_Comm_size(MCW, &size);
-	MPI_Comm_rank(MCW, &rank);
+//  Threads for the reads started by tiffIO::readStart.  A read of a file is one
+//  task, so each GDAL dataset is only used by one thread at a time while the
+//  different files are read at the same time.
+class ReadPool {
+	private:
+		std::mutex lock;
+		std::condition_variable ready;
+		deque< function<void()> > tasks;
+		vector<thread> workers;
+		bool stopping;
+
+		void work() {
+			for (;;) {
+				function<void()> task;
+				{
+					unique_lock<std::mutex> guard(lock);
+					ready.wait(guard, [this] { return stopping || !tasks.empty(); });
+					if (tasks.empty()) return;
+					task = tasks.front();
+					tasks.pop_front();
+				}
+				task();
+			}
+		}
 
-	strcpy(filename, fname); // Copy file name
-	datatype = newtype;
+	public:
+		ReadPool(int nthreads) {
+			stopping = false;
+			for (int i = 0; i < nthreads; i++)
+				workers.push_back(thread(&ReadPool::work, this));
+		}
 
-	GDALAllRegister();
-	fh = GDALOpen(filename, GA_ReadOnly);
-	if (fh == NULL) {
-		printf("Error opening file %s.\n", fname);
-		fflush(stdout);
-		MPI_Abort(MCW, 21);
-	}
-	hDriver = GDALGetDatasetDriver( fh );
+		~ReadPool() {
+			{
+				lock_guard<std::mutex> guard(lock);
+				stopping = true;
+			}
+			ready.notify_all();
+			for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+		}
 
-    //OGRSpatialReferenceH  hSRS;
-	char  *pszProjection;
-	pszProjection = (char *) GDALGetProjectionRef( fh );
-	hSRS = OSRNewSpatialReference(pszProjection);
-    IsGeographic=OSRIsGeographic(hSRS);
-	if (IsGeographic ==0) {
-		if(rank == 0)printf("Input file %s has projected coordinate system.\n",fname);
-	}
-	else
-		if(rank == 0)printf("Input file %s has geographic coordinate system.\n",fname);
-    // cout<<getproj<<endl; // for test
-	char *test_unit=NULL;
-	double ss;
-	ss=OSRGetLinearUnits(hSRS,&test_unit); // provide linear units
-	//cout<<ss<<endl;// for test
-	bandh = GDALGetRasterBand(fh, 1);
-	valueUnit=GDALGetRasterUnitType(fh); // provide value units
-	//cout<<valueUnit<<endl; // for test
+		void submit(function<void()> task) {
+			{
+				lock_guard<std::mutex> guard(lock);
+				tasks.push_back(task);
+			}
+			ready.notify_one();
+		}
 
-	totalX = GDALGetRasterXSize(fh);
-	totalY = GDALGetRasterYSize(fh);
-	double adfGeoTransform[6];
-	GDALGetGeoTransform(fh, adfGeoTransform);
-    dlon = abs(adfGeoTransform[1]); //modified by Nazmus 02/1/15
-	dlat = abs(adfGeoTransform[5]);
-	xleftedge = adfGeoTransform[0]; // geo-coordinate
-	ytopedge = adfGeoTransform[3];  
-	xllcenter=xleftedge+dlon/2.;
-	yllcenter=ytopedge-(totalY*dlat)-dlat/2.;
+		static ReadPool &get() {
+			static ReadPool pool(READTHREADS);
+			return pool;
+		}
+};
+
+//  Window of the grids set by setGridWindow, used by every tiffIO opened afterwards
+static bool gridWindowSet = false;
+static long gridWindowX, gridWindowY, gridWindowNX, gridWindowNY;
+
+//Limit the tools to the window of nx by ny cells at column xoff and row yoff.
+//The files opened afterwards are read and reported as this window, with row
+//and column 0 at its upper left cell, and written back at its place in the grid.
+void setGridWindow(long xoff, long yoff, long nx, long ny) {
+	gridWindowSet = true;
+	gridWindowX = xoff;
+	gridWindowY = yoff;
+	gridWindowNX = nx;
+	gridWindowNY = ny;
+}
 
-//	double  xllcenter_g = adfGeoTransform[0] + adfGeoTransform[1] * (totalX / 2.0) + adfGeoTransform[2] * (totalY / 2.0);//geo-coordinate
-//	double  yllcenter_g = adfGeoTransform[3] + adfGeoTransform[4] * (totalX / 2.0) + adfGeoTransform[5] * (totalY / 2.0);
+//Set the grid window to the bounding box of the valid cells of file.  Returns
+//false, keeping the whole grid, if the file has no valid cells.
+bool setValidWindow(char *file) {
+	long x0, y0, nx, ny;
+	bool found;
+	{
+		tiffIO f(file, FLOAT_TYPE);
+		found = f.validBounds(x0, y0, nx, ny);
+		if (found && f.getRank() == 0) {
+			printf("Processing window of %ld by %ld cells at column %ld, row %ld of the %u by %u grid\n",
+				nx, ny, x0, y0, f.getTotalX(), f.getTotalY());
+			fflush(stdout);
+		}
+	}
+	if (found) setGridWindow(x0, y0, nx, ny);
+	return found;
+}
 
-	
-	//xleftedge= adfGeoTransform[0];
-	//double *ytopedge_p, *yllcenter_p;
-	//ytopedge_p = geotoLength(dlon,dlat,ytopedge_g);
-	//xllcenter = adfGeoTransform[0] + adfGeoTransform[1] * (totalX / 2.0) + adfGeoTransform[2] * (totalY / 2.0);
-	//yllcenter_p = geotoLength(dlon,dlat,yllcenter_g);
-	
-	
-	//double beta1 = atan(boa*tan(PI*ytopedge_g/180));
-	//double beta2 = atan(boa*tan(PI*yllcenter_g/180));
+tiffIO::tiffIO(char *fname, DATA_TYPE newtype) {
+	MPI_Comm_size(MCW, &size);
+	MPI_Comm_rank(MCW, &rank);
 
-	//xleftedge=elipa*cos(beta1);// convert cartesian coordinate
-	//ytopedge=elipb*sin(beta1);  
+	strcpy(filename, fname); // Copy file name
+	datatype = newtype;
+	fh = NULL;
+	bandh = NULL;
+	hDriver = NULL;
+	valueUnit = NULL;
+
+	//  Only rank 0 opens the file here.  It reads the metadata and sends it to the
+	//  other processes in one packed buffer, so they do not touch the file system
+	//  until they read the grid values, see openDataset.
+	double adfGeoTransform[6];
+	const char *pszProjection = "";
+	int wktLength = 0;
+	int i,j;
+	if (rank == 0) {
+		openDataset();
+		pszProjection = GDALGetProjectionRef( fh );
+		wktLength = strlen(pszProjection) + 1;
+		valueUnit=GDALGetRasterUnitType(fh); // provide value units
+		totalX = GDALGetRasterXSize(fh);
+		totalY = GDALGetRasterYSize(fh);
+		GDALGetGeoTransform(fh, adfGeoTransform);
+		nodata = GDALGetRasterNoDataValue(bandh, NULL); // noDatarefactor 11/18/17
+		// Per gdal.h header and internet searches GDALGetRasterNoDataValue is a double
+		hSRS = OSRNewSpatialReference(pszProjection);
+		IsGeographic=OSRIsGeographic(hSRS);
+	}
 
-	//xllcenter= elipa*cos(beta2); // convert cartesian coordinate
-	//yllcenter=elipb*sin(beta2);
+	//  Sizes first, so the other processes can hold the packed buffer
+	int header[4] = { (int)totalX, (int)totalY, IsGeographic, wktLength };
+	MPI_Bcast(header, 4, MPI_INT, 0, MCW);
+	totalX = header[0];
+	totalY = header[1];
+	IsGeographic = header[2];
+	wktLength = header[3];
 
-	int i,j;double xp3,Xp1,Yp1;
-	double xp2[2];
 	dxc = new double[totalY];	
 	dyc = new double [totalY];
-	if (IsGeographic ==1) 
-	{
-	//for(i=0; i<totalX; i++ ) {
-		for( j=0;j<totalY;j++){
-			// latitude corresponding to row
-			float rowlat = yllcenter+(totalY-j-1)*dlat;
-			//Xp1 = adfGeoTransform[0] + i*adfGeoTransform[1] + j*adfGeoTransform[2];
-			//Yp1= adfGeoTransform[3] + adfGeoTransform[4] + j*adfGeoTransform[5];
-			//printf("%f",Yp1);
-			geotoLength(dlon,dlat,rowlat,xp2);
-			dxc[j]=xp2[0];
-			//printf("%f",dxc[j]);
-			dyc[j]=xp2[1];
-			//printf("%f",dyc[j]);
+	if (rank == 0) {
+		dlon = fabs(adfGeoTransform[1]); //modified by Nazmus 02/1/15
+		dlat = fabs(adfGeoTransform[5]);
+		xleftedge = adfGeoTransform[0]; // geo-coordinate
+		ytopedge = adfGeoTransform[3];  
+		xllcenter=xleftedge+dlon/2.;
+		yllcenter=ytopedge-(totalY*dlat)-dlat/2.;
+
+		double xp2[2];
+		if (IsGeographic ==1) 
+		{
+			for( j=0;j<totalY;j++){
+				// latitude corresponding to row
+				float rowlat = yllcenter+(totalY-j-1)*dlat;
+				geotoLength(dlon,dlat,rowlat,xp2);
+				dxc[j]=xp2[0];
+				dyc[j]=xp2[1];
+			}
 		}
-	//}
-	}
-	else
-	{
-		for( j=0;j<totalY;j++)
+		else
 		{
-			dxc[j]=dlon;
-			dyc[j]=dlat;
+			for( j=0;j<totalY;j++)
+			{
+				dxc[j]=dlon;
+				dyc[j]=dlat;
+			}
 		}
 	}
 
+	//  Geotransform, nodata, projection and the cell sizes of each row
+	int packSize, partSize;
+	MPI_Pack_size(7, MPI_DOUBLE, MCW, &packSize);
+	MPI_Pack_size(wktLength, MPI_CHAR, MCW, &partSize);
+	packSize += partSize;
+	MPI_Pack_size(totalY, MPI_DOUBLE, MCW, &partSize);
+	packSize += 2 * partSize;
+	char *packed = new char[packSize];
+	char *wkt = new char[wktLength > 0 ? wktLength : 1];
+	int position = 0;
+	if (rank == 0) {
+		MPI_Pack(adfGeoTransform, 6, MPI_DOUBLE, packed, packSize, &position, MCW);
+		MPI_Pack(&nodata, 1, MPI_DOUBLE, packed, packSize, &position, MCW);
+		MPI_Pack((void*)pszProjection, wktLength, MPI_CHAR, packed, packSize, &position, MCW);
+		MPI_Pack(dxc, totalY, MPI_DOUBLE, packed, packSize, &position, MCW);
+		MPI_Pack(dyc, totalY, MPI_DOUBLE, packed, packSize, &position, MCW);
+	}
+	MPI_Bcast(packed, packSize, MPI_PACKED, 0, MCW);
+	if (rank != 0) {
+		MPI_Unpack(packed, packSize, &position, adfGeoTransform, 6, MPI_DOUBLE, MCW);
+		MPI_Unpack(packed, packSize, &position, &nodata, 1, MPI_DOUBLE, MCW);
+		MPI_Unpack(packed, packSize, &position, wkt, wktLength, MPI_CHAR, MCW);
+		MPI_Unpack(packed, packSize, &position, dxc, totalY, MPI_DOUBLE, MCW);
+		MPI_Unpack(packed, packSize, &position, dyc, totalY, MPI_DOUBLE, MCW);
+		hSRS = OSRNewSpatialReference(wkt);
+		dlon = fabs(adfGeoTransform[1]);
+		dlat = fabs(adfGeoTransform[5]);
+		xleftedge = adfGeoTransform[0];
+		ytopedge = adfGeoTransform[3];  
+		xllcenter=xleftedge+dlon/2.;
+		yllcenter=ytopedge-(totalY*dlat)-dlat/2.;
+	}
+	delete[] packed;
+	delete[] wkt;
+
+	//  Byte grids only hold -127 to 127, the cells that are nodata in the
+	//  file are set to MISSINGBYTE as they are read
+	filenodata = nodata;
+	if (datatype == BYTE_TYPE) nodata = MISSINGBYTE;
+
+	if (IsGeographic ==0) {
+		if(rank == 0)printf("Input file %s has projected coordinate system.\n",fname);
+	}
+	else
+		if(rank == 0)printf("Input file %s has geographic coordinate system.\n",fname);
+
 	//dxA=(dxc[totalY/2]<0.0) ? -dxc[totalY/2] : dxc[totalY/2] ;   //abs(dxc[totalY/2]);  //  DGT This is ugly but we encountered a compiler that the abs function rounded the results which introduced a bug
 	//dyA=(dyc[totalY/2]<0.0) ? -dyc[totalY/2] : dyc[totalY/2] ;  //abs(dyc[totalY/2]);
 	dxA=fabs(dxc[totalY/2]);
     dyA= fabs(dyc[totalY/2]);
-    datatype = newtype;
-	//GDALDataType gdfiledt;
-	//gdfiledt = GDALGetRasterDataType(bandh);
-	nodata = GDALGetRasterNoDataValue(bandh, NULL); // noDatarefactor 11/18/17
-	// Per gdal.h header and internet searches GDALGetRasterNoDataValue is a double
-	/* if (datatype == SHORT_TYPE) {
-		nodata = new int16_t;
-		*((int16_t*) nodata) = (int16_t) GDALGetRasterNoDataValue(bandh, NULL);
 
-	} else if (datatype == FLOAT_TYPE) {
-		nodata = new float;
-		*((float*) nodata) = (float) GDALGetRasterNoDataValue(bandh, NULL);		
-
-	} else if (datatype == LONG_TYPE) {
-		nodata = new int32_t;
-		*((int32_t*) nodata) = (int32_t) GDALGetRasterNoDataValue(bandh, NULL);		
-
-	} */ 
+	//  The tools only see the grid window, dxc and dyc are kept for the whole file
+	fileX = totalX;
+	fileY = totalY;
+	xoff = yoff = 0;
+	if (gridWindowSet) {
+		if (gridWindowX + gridWindowNX > fileX || gridWindowY + gridWindowNY > fileY) {
+			printf("Grid window does not fit in file %s\n", fname);
+			fflush(stdout);
+			MPI_Abort(MCW, 24);
+		}
+		xoff = gridWindowX;
+		yoff = gridWindowY;
+		totalX = gridWindowNX;
+		totalY = gridWindowNY;
+	}
+	readRows = rowsLoaded = 0;
+	readFailed = false;
+}
 
+//Open the file to read it.  Rank 0 opens it in the constructor, the other
+//processes when they first read grid values.
+void tiffIO::openDataset() {
+	if (fh != NULL) return;
+	GDALAllRegister();
+	fh = GDALOpen(filename, GA_ReadOnly);
+	if (fh == NULL) {
+		printf("Error opening file %s.\n", filename);
+		fflush(stdout);
+		MPI_Abort(MCW, 21);
+	}
+	hDriver = GDALGetDatasetDriver( fh );
+	bandh = GDALGetRasterBand(fh, 1);
 }
 
 //Copy constructor.  Requires datatype in addition to the object to copy from.
@@ -193,6 +317,9 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype, double nd, const tiffIO &copy) {
 	
 	datatype = newtype;
 	nodata = nd;  // noDatarefactor 11/18/17
+	filenodata = nd;
+	readRows = rowsLoaded = 0;
+	readFailed = false;
 		
 	/*if (datatype == SHORT_TYPE) {
 		nodata = new int16_t;
@@ -207,6 +334,10 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype, double nd, const tiffIO &copy) {
 
 	totalX = copy.totalX;
 	totalY = copy.totalY;
+	fileX = copy.fileX;
+	fileY = copy.fileY;
+	xoff = copy.xoff;
+	yoff = copy.yoff;
 	dxA=copy.dxA;
 	dyA=copy.dyA;
 	xllcenter = copy.xllcenter;
@@ -216,10 +347,10 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype, double nd, const tiffIO &copy) {
 	dlon=copy.dlon;
 	dlat=copy.dlat;
 	//note: is it necessary to get these values in writing???
-	dxc = new double[totalY];	
-	dyc = new double [totalY];
+	dxc = new double[fileY];	
+	dyc = new double [fileY];
     int i;
-	for(i=0; i<totalY; i++ ) {
+	for(i=0; i<fileY; i++ ) {
 		dxc[i] = copy.dxc[i];
 		dyc[i] = copy.dyc[i];
 	}
@@ -227,7 +358,7 @@ tiffIO::tiffIO(char *fname, DATA_TYPE newtype, double nd, const tiffIO &copy) {
 }
 
 tiffIO::~tiffIO() {
-
+	readWait();
 	delete dxc;
 	delete dyc;
 }
@@ -237,25 +368,196 @@ tiffIO::~tiffIO() {
 
 void tiffIO::read(long xstart, long ystart, long numRows, long numCols, void* dest) {
 	//cout << "read: " << xstart << " " << ystart << " " << numRows << " " << numCols << endl;
+	readStart(xstart, ystart, numRows, numCols, dest);
+	readWait();
+}
+
+//Start reading the window in the background.  dest must stay valid until readWait()
+//returns, and the rows of the window can be used as soon as readWait(rows) returns.
+void tiffIO::readStart(long xstart, long ystart, long numRows, long numCols, void* dest) {
+	readWait();
+	bool empty = (numRows <= 0 || numCols <= 0);
+	{
+		lock_guard<std::mutex> guard(readMutex);
+		readRows = numRows;
+		rowsLoaded = empty ? numRows : 0;
+	}
+	if (empty) return;
+	openDataset();
+	ReadPool::get().submit([=] { readChunks(xstart, ystart, numRows, numCols, dest); });
+}
+
+//Wait until the first numRows rows of the window started by readStart are in memory
+void tiffIO::readWait(long numRows) {
+	unique_lock<std::mutex> guard(readMutex);
+	if (numRows > readRows) numRows = readRows;
+	readProgress.wait(guard, [&] { return rowsLoaded >= numRows || readFailed; });
+	if (readFailed) {
+		printf("Error reading file %s\n", filename);
+		fflush(stdout);
+		MPI_Abort(MCW, 23);
+	}
+}
+
+//Wait until the whole window started by readStart is in memory
+void tiffIO::readWait() {
+	readWait(readRows);
+}
+
+//Read the window a chunk of rows at a time, on a thread of the read pool.
+//Chunks start and end on the block rows of the file, except at the ends of
+//the window, so GDAL reads each block once and does not keep partial blocks.
+void tiffIO::readChunks(long xstart, long ystart, long numRows, long numCols, void* dest) {
 	GDALDataType eBDataType;
-		if (datatype == FLOAT_TYPE)
-			eBDataType = GDT_Float32;
-		else if (datatype == SHORT_TYPE)
-			eBDataType = GDT_Int16;
-		else if (datatype == LONG_TYPE)
-			eBDataType = GDT_Int32;
+	int cellbytes = 4;
+	if (datatype == FLOAT_TYPE)
+		eBDataType = GDT_Float32;
+	else if (datatype == SHORT_TYPE) {
+		eBDataType = GDT_Int16;
+		cellbytes = 2;
+	}
+	else if (datatype == LONG_TYPE)
+		eBDataType = GDT_Int32;
+	else if (datatype == BYTE_TYPE) {
+		//  Read as short and narrowed, without needing the Int8 type of GDAL 3.7
+		eBDataType = GDT_Int16;
+		cellbytes = 1;
+	}
+	vector <int16_t> wide;
+
+	int blockCols, blockRows;
+	GDALGetBlockSize(bandh, &blockCols, &blockRows);
+	if (blockRows < 1) blockRows = 1;
+	long chunkRows = READCHUNKCELLS / numCols;
+	chunkRows -= chunkRows % blockRows;
+	if (chunkRows < blockRows) chunkRows = blockRows;
+
+	//  Rows of the file
+	xstart += xoff;
+	ystart += yoff;
+	long end = ystart + numRows;
+	for (long row = ystart; row < end; ) {
+		long next = (row / chunkRows + 1) * chunkRows;
+		if (next > end) next = end;
+		char *chunk = (char*)dest + (row - ystart) * numCols * cellbytes;
+		long cells = (next - row) * numCols;
+		if (datatype == BYTE_TYPE) wide.resize(cells);
+		CPLErr err = GDALRasterIO(bandh, GF_Read, xstart, row, numCols, next - row,
+			datatype == BYTE_TYPE ? (void*)&wide[0] : (void*)chunk, numCols, next - row, eBDataType,
+			0, 0);
+		if (datatype == BYTE_TYPE && err != CE_Failure) {
+			//  Nodata and the values that do not fit are MISSINGBYTE
+			int8_t *bytes = (int8_t*)chunk;
+			for (long k = 0; k < cells; k++) {
+				int16_t v = wide[k];
+				bytes[k] = (v == filenodata || v < -127 || v > 127) ? MISSINGBYTE : (int8_t)v;
+			}
+		}
+		{
+			lock_guard<std::mutex> guard(readMutex);
+			if (err == CE_Failure) readFailed = true;
+			else rowsLoaded = next - ystart;
+			//  Notified under the lock, readWait may return and the tiffIO
+			//  be destroyed as soon as the lock is released
+			readProgress.notify_all();
+		}
+		if (err == CE_Failure) return;
+		row = next;
+	}
+}
+
+//Count the cells that are not nodata in rows firstRow to firstRow+numRows-1 into
+//rowCounts, and widen colMin and colMax to the columns of the valid cells found.
+void tiffIO::scanValidCells(long firstRow, long numRows, long *rowCounts, long &colMin, long &colMax) {
+	const long chunkRows = 64;
+	openDataset();
+	int hasNodata;
+	double fileNodata = GDALGetRasterNoDataValue(bandh, &hasNodata);
+	double *buf = new double[chunkRows * totalX];
+	for (long j = 0; j < numRows; j += chunkRows) {
+		long n = numRows - j < chunkRows ? numRows - j : chunkRows;
+		GDALRasterIO(bandh, GF_Read, xoff, yoff + firstRow + j, totalX, n,
+			buf, totalX, n, GDT_Float64, 0, 0);
+		for (long k = 0; k < n; k++) {
+			const double *row = buf + k * totalX;
+			long count = 0;
+			for (long i = 0; i < totalX; i++) {
+				double v = row[i];
+				if (!hasNodata || (v != fileNodata && !(v != v && fileNodata != fileNodata))) {
+					if (i < colMin) colMin = i;
+					if (i > colMax) colMax = i;
+					count++;
+				}
+			}
+			rowCounts[j + k] = count;
+		}
+	}
+	delete[] buf;
+}
 
+//Count the cells that are not nodata in each of the totalY rows of the file into rowCounts.
+//Each process reads an equal share of the rows, the counts are then gathered on all processes.
+void tiffIO::validCellsPerRow(long *rowCounts) {
+	long rowsPerProc = totalY / size;
+	long firstRow = rank * rowsPerProc;
+	long numRows = rowsPerProc;
+	if (rank == size - 1) numRows += totalY % size;
+
+	long *myCounts = new long[numRows > 0 ? numRows : 1];
+	long colMin = totalX, colMax = -1;
+	scanValidCells(firstRow, numRows, myCounts, colMin, colMax);
+
+	int *recvCounts = new int[size];
+	int *displs = new int[size];
+	for (int r = 0; r < size; r++) {
+		recvCounts[r] = rowsPerProc;
+		displs[r] = r * rowsPerProc;
+	}
+	recvCounts[size - 1] += totalY % size;
+	MPI_Allgatherv(myCounts, numRows, MPI_LONG, rowCounts, recvCounts, displs, MPI_LONG, MCW);
+	delete[] recvCounts;
+	delete[] displs;
+	delete[] myCounts;
+}
 
-	GDALRasterIO(bandh, GF_Read, xstart, ystart, numCols, numRows,
-		dest, numCols, numRows,eBDataType ,
-		0, 0);
+//Bounding box of the cells that are not nodata, on all processes.  Each process
+//scans an equal share of the rows.  Returns false if there are no such cells.
+bool tiffIO::validBounds(long &x0, long &y0, long &nx, long &ny) {
+	long rowsPerProc = totalY / size;
+	long firstRow = rank * rowsPerProc;
+	long numRows = rowsPerProc;
+	if (rank == size - 1) numRows += totalY % size;
+
+	long *myCounts = new long[numRows > 0 ? numRows : 1];
+	long colMin = totalX, colMax = -1;
+	scanValidCells(firstRow, numRows, myCounts, colMin, colMax);
+	long rowMin = totalY, rowMax = -1;
+	for (long j = 0; j < numRows; j++) {
+		if (myCounts[j] == 0) continue;
+		if (rowMin == totalY) rowMin = firstRow + j;
+		rowMax = firstRow + j;
+	}
+	delete[] myCounts;
+
+	//  One reduction, the maxima as negative minima
+	long bounds[4] = { colMin, rowMin, -colMax, -rowMax };
+	long all[4];
+	MPI_Allreduce(bounds, all, 4, MPI_LONG, MPI_MIN, MCW);
+	if (-all[2] < all[0]) return false;
+	x0 = all[0];
+	y0 = all[1];
+	nx = -all[2] - all[0] + 1;
+	ny = -all[3] - all[1] + 1;
+	return true;
 }
 
 //Create/re-write tiff output file
 //BT void tiffIO::write(unsigned long long xstart, unsigned long long ystart, unsigned long long numRows, unsigned long long numCols, void* source) {
 
 void tiffIO::write(long xstart, long ystart, long numRows, long numCols, void* source) {
-	MPI_Status status;
+	//  The window is written at its place in the whole grid, nodata elsewhere
+	xstart += xoff;
+	ystart += yoff;
 	fflush(stdout);
 	char **papszMetadata;
 	char **papszOptions = NULL;
@@ -298,126 +600,175 @@ void tiffIO::write(long xstart, long ystart, long numRows, long numCols, void* s
 			index=0;
 		}
 	}
+	GDALDataType eBDataType;
+	if (datatype == FLOAT_TYPE)
+		eBDataType = GDT_Float32;
+	else if (datatype == SHORT_TYPE)
+		eBDataType = GDT_Int16;
+	else if (datatype == LONG_TYPE)
+		eBDataType = GDT_Int32;
+	else if (datatype == BYTE_TYPE)
+		eBDataType = GDT_Int16;  //  written as short, see below
+	int cellbytes=4;	
+	if (datatype == SHORT_TYPE)cellbytes=2;
+	if (datatype == BYTE_TYPE)cellbytes=1;
+	bool isGTiff = (strcmp(driver_code[index],"GTiff") == 0);
+	int blockRows = 1;
+
 	if (rank == 0) {
-		//if (isFileInititialized == 0) {
-			hDriver = GDALGetDriverByName(driver_code[index]);
-		    if (hDriver == NULL) {
-		        printf("GDAL driver is not available\n");
-				fflush(stdout);
-				MPI_Abort(MPI_COMM_WORLD, 22);
-			}
-			// Set options
-			if(index==0){  // for .tif files.  Refer to http://www.gdal.org/frmt_gtiff.html for GTiff options.
-				papszOptions = CSLSetNameValue( papszOptions, "COMPRESS", compression_meth[index]); 
-			}
-			else if(index==1){ // .img files.  Refer to http://www.gdal.org/frmt_hfa.html where COMPRESSED = YES are create options for ERDAS .img files
-				papszOptions = CSLSetNameValue( papszOptions, "COMPRESSED", compression_meth[index]);
+		hDriver = GDALGetDriverByName(driver_code[index]);
+		if (hDriver == NULL) {
+			printf("GDAL driver is not available\n");
+			fflush(stdout);
+			MPI_Abort(MPI_COMM_WORLD, 22);
+		}
+		// Set options
+		if(isGTiff){  // for .tif files.  Refer to http://www.gdal.org/frmt_gtiff.html for GTiff options.
+			papszOptions = CSLSetNameValue( papszOptions, "COMPRESS", outputOptions.compress); 
+			if(outputOptions.predictor > 0 && strcmp(outputOptions.compress,"NONE") != 0){
+				char predictor[16];
+				snprintf(predictor, sizeof(predictor), "%d", outputOptions.predictor);
+				papszOptions = CSLSetNameValue( papszOptions, "PREDICTOR", predictor);
 			}
-			int cellbytes=4;	
-			if (datatype == SHORT_TYPE)cellbytes=2;
-			double fileGB=(double)cellbytes*(double)totalX*(double)totalY/1000000000.0;  // This purposely neglects the lower significant digits to overvalue GB to allow space for header information in the file
-			if(fileGB > 4.0){
-				if(index==0 || index==6){  // .tiff files.  Need to explicity indicate BIGTIFF.  See http://www.gdal.org/frmt_gtiff.html.
-					papszOptions = CSLSetNameValue( papszOptions, "BIGTIFF", "YES");
-					printf("Setting BIGTIFF, File: %s, Anticipated size (GB):%.2f\n", filename,fileGB);
-				}
+			if(outputOptions.tiled){
+				char blockSize[16];
+				snprintf(blockSize, sizeof(blockSize), "%d", outputOptions.blockSize);
+				papszOptions = CSLSetNameValue( papszOptions, "TILED", "YES");
+				papszOptions = CSLSetNameValue( papszOptions, "BLOCKXSIZE", blockSize);
+				papszOptions = CSLSetNameValue( papszOptions, "BLOCKYSIZE", blockSize);
 			}
-
-			GDALDataType eBDataType;
-			if (datatype == FLOAT_TYPE)
-				eBDataType = GDT_Float32;
-			else if (datatype == SHORT_TYPE)
-			{
-				eBDataType = GDT_Int16;
+			if(outputOptions.bigtiff[0] != 0)
+				papszOptions = CSLSetNameValue( papszOptions, "BIGTIFF", outputOptions.bigtiff);
+		}
+		else if(index==1){ // .img files.  Refer to http://www.gdal.org/frmt_hfa.html where COMPRESSED = YES are create options for ERDAS .img files
+			papszOptions = CSLSetNameValue( papszOptions, "COMPRESSED", compression_meth[index]);
+		}
+		double fileGB=(double)(datatype == BYTE_TYPE ? 2 : cellbytes)*(double)fileX*(double)fileY/1000000000.0;  // This purposely neglects the lower significant digits to overvalue GB to allow space for header information in the file
+		if(fileGB > 4.0 && outputOptions.bigtiff[0] == 0){
+			if(isGTiff){  // .tiff files.  Need to explicity indicate BIGTIFF.  See http://www.gdal.org/frmt_gtiff.html.
+				papszOptions = CSLSetNameValue( papszOptions, "BIGTIFF", "YES");
+				printf("Setting BIGTIFF, File: %s, Anticipated size (GB):%.2f\n", filename,fileGB);
 			}
-			else if (datatype == LONG_TYPE)
-				eBDataType = GDT_Int32;
-	        
-   
-			fh = GDALCreate(hDriver, filename, totalX , totalY, 1, eBDataType, papszOptions);
-			GDALSetProjection(fh, GDALGetProjectionRef(copyfh));
-
-			double adfGeoTransform[6];
-			GDALGetGeoTransform(copyfh, adfGeoTransform);
-
-			GDALSetGeoTransform(fh, adfGeoTransform);
-
-			bandh = GDALGetRasterBand(fh, 1);
-			GDALSetRasterNoDataValue(bandh, nodata);  // noDatarefactor 11/18/17
-			/*if (datatype == FLOAT_TYPE) 
-	            GDALSetRasterNoDataValue(bandh, (double) *((float*) nodata));
-			else if (datatype == SHORT_TYPE)			
-				GDALSetRasterNoDataValue(bandh, (double) *((short*) nodata));			
-			else if (datatype == LONG_TYPE)		
-				GDALSetRasterNoDataValue(bandh, (double) *((int32_t*) nodata));*/
-
-			//isFileInititialized = 1;
-		//} else {
-			//  Open file if it has already been initialized
-			//fh = GDALOpen(filename, GA_Update);
-			//bandh = GDALGetRasterBand(fh, 1);
-		//}
-		//  Now write the data from rank 0 and close the file
-		//GDALDataType eBDataType;
-		//if (datatype == FLOAT_TYPE)
-			//eBDataType = GDT_Float32;
-		//else if (datatype == SHORT_TYPE)
-			//eBDataType = GDT_Int16;
-		//else if (datatype == LONG_TYPE)
-			//eBDataType = GDT_Int32;
-
-		GDALRasterIO(bandh, GF_Write, xstart, ystart, numCols, numRows,
-			source, numCols, numRows, eBDataType,
-			0, 0);
-		
-		GDALFlushCache(fh);  //  DGT effort get large files properly written
-		GDALClose(fh);
-
-		//  Send message to rank 1
-		int d = 0;
-		if (size > rank + 1){
-			//     buffer, count, datatype, dest, tag, comm
-			MPI_Send(&d, 1, MPI_INT, 1, 1, MPI_COMM_WORLD);
-			//printf("Written rank: %d\n", rank);
-			fflush(stdout);
 		}
 
-	} else {
-		int d = 0;
-		//   buffer, count, datatype, source, tag, com, status
-		MPI_Recv(&d, 1, MPI_INT, rank - 1, 1, MPI_COMM_WORLD, &status);  //DGT check status to see that receive was correct.  Print status and rank
-		
-		int number_amount;
-		MPI_Get_count(&status, MPI_INT, &number_amount);
-        //printf("Triggered in rank: %d Received %d\n", rank,number_amount);
-		fflush(stdout);
+		fh = GDALCreate(hDriver, filename, fileX , fileY, 1, eBDataType, papszOptions);
+		CSLDestroy(papszOptions);
+		GDALSetProjection(fh, GDALGetProjectionRef(copyfh));
 
-		//  Once message received open file and write the data from rank > 0 then close
-		fh = GDALOpen(filename, GA_Update);
-		bandh = GDALGetRasterBand(fh, 1);
+		double adfGeoTransform[6];
+		GDALGetGeoTransform(copyfh, adfGeoTransform);
 
-		GDALDataType eBDataType;
-		if (datatype == FLOAT_TYPE)
-			eBDataType = GDT_Float32;
-		else if (datatype == SHORT_TYPE)
-			eBDataType = GDT_Int16;
-		else if (datatype == LONG_TYPE)
-			eBDataType = GDT_Int32;
+		GDALSetGeoTransform(fh, adfGeoTransform);
 
-		GDALRasterIO(bandh, GF_Write, xstart, ystart, numCols, numRows,
-			source, numCols, numRows, eBDataType,
-			0, 0);
-
-		GDALFlushCache(fh);  //  DGT effort get large files properly written
-		GDALClose(fh);	
+		bandh = GDALGetRasterBand(fh, 1);
+		GDALSetRasterNoDataValue(bandh, nodata);  // noDatarefactor 11/18/17
+		int blockCols;
+		GDALGetBlockSize(bandh, &blockCols, &blockRows);
+	}
+	MPI_Bcast(&blockRows, 1, MPI_INT, 0, MCW);
+
+	//  Rank 0 is the only one to open the file.  It writes the grid in bands of
+	//  whole rows, and each process sends it the rows of its window that fall in
+	//  the band, so the time to write does not grow with one open per process.
+	//  Bands are a whole number of blocks so each tile or strip is compressed once.
+	long window[4] = { xstart, ystart, numRows, numCols };
+	long *windows = NULL;
+	if (rank == 0) windows = new long[4 * size];
+	MPI_Gather(window, 4, MPI_LONG, windows, 4, MPI_LONG, 0, MCW);
+
+	long bandRows = WRITEBANDCELLS / fileX;
+	bandRows -= bandRows % blockRows;
+	if (bandRows < blockRows) bandRows = blockRows;
+	if (bandRows > fileY) bandRows = fileY;
+	char *src = (char*)source;
+
+	if (rank != 0) {
+		//  Send the rows of each band at once, the rows of the window are contiguous
+		long nbands = (fileY + bandRows - 1) / bandRows;
+		MPI_Request *reqs = new MPI_Request[nbands];
+		int nreqs = 0;
+		for (long b = 0; b < fileY; b += bandRows) {
+			long r0 = ystart > b ? ystart : b;
+			long r1 = ystart + numRows < b + bandRows ? ystart + numRows : b + bandRows;
+			if (r0 >= r1 || numCols <= 0) continue;
+			MPI_Isend(src + (r0 - ystart) * numCols * cellbytes, (r1 - r0) * numCols * cellbytes, MPI_BYTE,
+				0, WRITETAG, MCW, &reqs[nreqs++]);
+		}
+		MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE);
+		delete[] reqs;
+		return;
+	}
 
-		//  send message to next rank up only if not last one
-		if (size > rank + 1){
-			//     buffer, count, datatype, dest, tag, comm
-			MPI_Send(&d, 1, MPI_INT, rank + 1, 1, MPI_COMM_WORLD);
-			//printf("Written rank: %d\n", rank);
-			fflush(stdout);
+	char *band = new char[bandRows * fileX * cellbytes];
+	MPI_Request *reqs = new MPI_Request[size];
+	for (long b = 0; b < fileY; b += bandRows) {
+		long n = fileY - b < bandRows ? fileY - b : bandRows;
+		fillNodata(band, n * fileX);
+		int nreqs = 0;
+		for (int r = 0; r < size; r++) {
+			long wx = windows[4 * r], wy = windows[4 * r + 1];
+			long wrows = windows[4 * r + 2], wcols = windows[4 * r + 3];
+			long r0 = wy > b ? wy : b;
+			long r1 = wy + wrows < b + n ? wy + wrows : b + n;
+			if (r0 >= r1 || wcols <= 0) continue;
+			char *dest = band + ((r0 - b) * fileX + wx) * cellbytes;
+			if (r == 0) {
+				for (long j = r0; j < r1; j++)
+					memcpy(dest + (j - r0) * fileX * cellbytes, src + (j - ystart) * numCols * cellbytes, numCols * cellbytes);
+				continue;
+			}
+			//  Receive the rows straight into their place in the band
+			MPI_Datatype rowsType;
+			MPI_Type_vector(r1 - r0, wcols * cellbytes, fileX * cellbytes, MPI_BYTE, &rowsType);
+			MPI_Type_commit(&rowsType);
+			MPI_Irecv(dest, 1, rowsType, r, WRITETAG, MCW, &reqs[nreqs++]);
+			MPI_Type_free(&rowsType);
 		}
+		MPI_Waitall(nreqs, reqs, MPI_STATUSES_IGNORE);
+		if (datatype == BYTE_TYPE) {
+			//  Widened to short, without needing the Int8 type of GDAL 3.7
+			vector <int16_t> wide((int8_t*)band, (int8_t*)band + n * fileX);
+			GDALRasterIO(bandh, GF_Write, 0, b, fileX, n, &wide[0], fileX, n, eBDataType, 0, 0);
+		}
+		else
+			GDALRasterIO(bandh, GF_Write, 0, b, fileX, n, band, fileX, n, eBDataType, 0, 0);
+	}
+	delete[] reqs;
+	delete[] band;
+	delete[] windows;
+
+	//  Internal overviews, halving the grid down to about one tile
+	if (isGTiff && outputOptions.overviews) {
+		int levels[32];
+		int nlevels = 0;
+		long largest = fileX > fileY ? fileX : fileY;
+		for (int f = 2; largest / f >= outputOptions.blockSize / 2 && nlevels < 32; f *= 2)
+			levels[nlevels++] = f;
+		if (nlevels > 0)
+			GDALBuildOverviews(fh, "NEAREST", nlevels, levels, 0, NULL, NULL, NULL);
+	}
+
+	GDALFlushCache(fh);  //  DGT effort get large files properly written
+	GDALClose(fh);
+}
+
+//Fill n cells of buf with the nodata value, in the data type of the grid
+void tiffIO::fillNodata(void *buf, long n) {
+	if (datatype == FLOAT_TYPE) {
+		float nd = (float)nodata;
+		for (long i = 0; i < n; i++) ((float*)buf)[i] = nd;
+	}
+	else if (datatype == SHORT_TYPE) {
+		int16_t nd = (int16_t)nodata;
+		for (long i = 0; i < n; i++) ((int16_t*)buf)[i] = nd;
+	}
+	else if (datatype == LONG_TYPE) {
+		int32_t nd = (int32_t)nodata;
+		for (long i = 0; i < n; i++) ((int32_t*)buf)[i] = nd;
+	}
+	else if (datatype == BYTE_TYPE) {
+		int8_t nd = (int8_t)nodata;
+		for (long i = 0; i < n; i++) ((int8_t*)buf)[i] = nd;
 	}
 }
 
@@ -576,8 +927,8 @@ void tiffIO::geoToGlobalXY(double geoX, double geoY, int &globalX, int &globalY)
 	//  This returns the corresponding row and column in the array.  
 	//  The function is the same for geographic and projected coordinates 
 
-	globalX = (int)((geoX - xleftedge) / dlon);
-	globalY = (int)((ytopedge - geoY) / dlat);
+	globalX = (int)((geoX - xleftedge) / dlon) - xoff;
+	globalY = (int)((ytopedge - geoY) / dlat) - yoff;
 
 }
 
@@ -586,7 +937,7 @@ void tiffIO::geoToGlobalXY(double geoX, double geoY, int &globalX, int &globalY)
 
 void tiffIO::globalXYToGeo(long globalX, long globalY, double &geoX, double &geoY) {
 	
-	geoX = xleftedge + dlon / 2. + globalX*dlon;
-	geoY = ytopedge - dlat / 2. - globalY*dlat;
+	geoX = xleftedge + dlon / 2. + (globalX + xoff)*dlon;
+	geoY = ytopedge - dlat / 2. - (globalY + yoff)*dlat;
 }
 
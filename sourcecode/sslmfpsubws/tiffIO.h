@@ -50,6 +50,8 @@ email:  dtarb@usu.edu
 #include <gdal.h>
 #include <cpl_conv.h>
 #include <cpl_string.h>
+#include <mutex>
+#include <condition_variable>
 #include <ogr_spatialref.h>
 #include "commonLib.h"
 
@@ -65,6 +67,15 @@ const short BIGENDIAN = 19789;
 const short TIFF = 42;
 const short BIGTIFF = 43;
 
+//  tiffIO::write gathers the grid on rank 0 in bands of about this many cells
+const long WRITEBANDCELLS = 16777216;
+const int WRITETAG = 2;
+
+//  tiffIO::readStart reads in chunks of whole blocks of about this many cells,
+//  on a pool of READTHREADS threads shared by all the files
+const long READCHUNKCELLS = 4194304;
+const int READTHREADS = 4;
+
 struct geotiff{
 	long xresNum;              //??? unsigned long BT - numerator for horizontal resolution 
 	long xresDen;              //??? unsigned long BT - denominator for horizontal resolution
@@ -107,16 +118,18 @@ class tiffIO{
 		int rank, size;			//MPI rank & size, rank=number for this process, size=number of processes
 		uint32_t totalX;		//DGT	// unsigned long BT - ??width of entire grid in number of cells (all partitions)
 		uint32_t totalY;		//DGT	// unsigned long BT - ??length of entire grid in number of cells (all partitions)
+		uint32_t fileX, fileY;	//size of the file, larger than totalX, totalY when a grid window is set
+		long xoff, yoff;		//column and row of the file at the upper left of the grid window
 		//double dx;				//??width of each cell
 		//double dy;				//??length of each cell
                 double xllcenter;		//horizontal center point of lower left grid cell in grographic coordinates, not grid coordinates
 		double yllcenter;		//vertical center point of lower left grid cell in geographic coordinates, not grid coordinates
 		double xleftedge;		//horizontal coordinate of left edge of grid in geographic coordinates, not grid coordinates
 		double ytopedge;		//vertical coordinate of top edge of grid in geographic coordinates, not grid coordinates
-		DATA_TYPE datatype;		//datatype of the grid values and the nodata value: short, long, or float
+		DATA_TYPE datatype;		//datatype of the grid values and the nodata value: byte, short, long, or float
 		//void *nodata;    //pointer to the nodata value, the nodata value type is indicated by datatype
 		double nodata;	// noDatarefactor 11/18/17		
-		void *filenodata;       //pointer to no data value from the file.  This may be different from nodata because filedatatype and datatype are not equivalent 
+		double filenodata;      //no data value from the file.  This may be different from nodata because filedatatype and datatype are not equivalent, see BYTE_TYPE
 		char filename[MAXLN];  //  Save filename for error or warning writes
 		const char *valueUnit; //value units
 		double *Yp;
@@ -124,6 +137,18 @@ class tiffIO{
 	    double dxA,dyA,dlat,dlon,xleftedge_g,ytopedge_g,xllcenter_g,yllcenter_g;
 	    int IsGeographic;
 		OGRSpatialReferenceH  hSRS;
+
+		void openDataset();
+		void fillNodata(void *buf, long n);
+		void scanValidCells(long firstRow, long numRows, long *rowCounts, long &colMin, long &colMax);
+
+		//  Read started by readStart, done by a thread of the read pool
+		std::mutex readMutex;
+		std::condition_variable readProgress;
+		long readRows;          //  rows of the window being read
+		long rowsLoaded;        //  rows of the window already in memory
+		bool readFailed;
+		void readChunks(long xstart, long ystart, long numRows, long numCols, void* dest);
 		
 //  Mappings
 
@@ -137,7 +162,12 @@ class tiffIO{
 		//BT void read(unsigned long long xstart, unsigned long long ystart, unsigned long long numRows, unsigned long long numCols, void* dest);
 		//BT void write(unsigned long long xstart, unsigned long long ystart, unsigned long long numRows, unsigned long long numCols, void* source);
 		void read(long xstart, long ystart, long numRows, long numCols, void* dest);
+		void readStart(long xstart, long ystart, long numRows, long numCols, void* dest);
+		void readWait(long numRows);
+		void readWait();
 		void write(long xstart, long ystart, long numRows, long numCols, void* source);
+		void validCellsPerRow(long *rowCounts);
+		bool validBounds(long &x0, long &y0, long &nx, long &ny);
 
 		bool compareTiff(const tiffIO &comp);
 				
@@ -158,18 +188,19 @@ class tiffIO{
 			if (index < 0 || index >= totalY)
 				return -1;
 
-			return dyc[index];
+			return dyc[index + yoff];
 		}
 
 		double getdxc(int index) {
 			if (index < 0 || index >= totalY)
 				return -1;
 
-			return dxc[index];
+			return dxc[index + yoff];
 		}
 
-		double getdxA() { return fabs(dxc[totalY/2]); }
-		double getdyA() { return fabs(dyc[totalY/2]); }
+		double getdxA() { return fabs(dxc[fileY/2]); }
+		double getdyA() { return fabs(dyc[fileY/2]); }
+		int getRank() { return rank; }
 		double getdlon() {return dlon;}
 		double getdlat() {return dlat;}
 		int getproj() {return IsGeographic;}
@@ -190,4 +221,7 @@ class tiffIO{
 		//void* getNodata(){return nodata;}
 };
 
+void setGridWindow(long xoff, long yoff, long nx, long ny);
+bool setValidWindow(char *file);
+
 #endif